@@ -31,9 +31,9 @@
 //         ATMEGA48
 //         +----------+ +----------+
 //         | PC6/-RES |_| ADC5/PC5 | RTC-SCL
-//         | PD0/RXD      ADC4/PC4 | RTC-SDA
-//         | PD1/TXD      ADC3/PC3 | LDR (Brightness)
-//  Digit1 | PD2/INT0     ADC2/PC2 |
+//  RXD    | PD0/RXD      ADC4/PC4 | RTC-SDA
+//  TXD    | PD1/TXD      ADC3/PC3 | LDR (Brightness)
+//  Digit1 | PD2/INT0     ADC2/PC2 | RTC-MFP (optional)
 //  Digit2 | PD3/INT1     ADC1/PC1 |
 //  Digit3 | PD4/T0       ADC0/PC0 | BUTTON
 //         | VCC               GND |
@@ -48,312 +48,311 @@
 //
 //
 
-#include <stdlib.h>
-#include <util/delay_basic.h>
 #include <avr/interrupt.h>
-#include <avr/eeprom.h>
+#include <avr/sleep.h>
+#include <avr/power.h>
+#include <avr/pgmspace.h>
 
 #include "twi.h"
+#include "rtc.h"
+#include "adc.h"
+#include "display.h"
+#include "sched.h"
+#include "swclock.h"
+#include "bcd.h"
+#include "button.h"
+#include "console.h"
+#include "settings.h"
+#include "anim.h"
+
+
+// Task periods in ms
+#define LDR_PERIOD		100
+#define LDR_SLEEP_EVERY		20
+#define MENU_TICK		100	// The button events also wake the menu
+
+// Brightness changes, in 1/256 levels: readings closer than BRIGHT_HYST
+// to the current target are ignored, and the display moves towards the
+// target by at most BRIGHT_SLEW every LDR_PERIOD
+#define BRIGHT_HYST		192
+#define BRIGHT_SLEW		128
+
+// Random segment flips at boot, one per animation frame
+#define ATTRACT_FRAMES		255
+
+// Menu timings in ms: how long a label or an unchanged value is left
+// before moving on, and the wait for ZERO S and the light readout
+#define MENU_TIMEOUT		3000
+#define MENU_WAIT		60000
+
+// Settings menu items. A BCD or binary value is stepped from min to max
+// and written back to *var, then save() is called.
+#define ITEM_BCD	0	// *var holds BCD
+#define ITEM_BIN	1	// *var holds binary, stepped as BCD
+#define ITEM_PRESS	2	// save() is called on a press
+#define ITEM_LIGHT	3	// Shows the LDR reading
+
+typedef struct {
+	PGM_P label;
+	uint8_t kind;
+	uint8_t *var;
+	uint8_t min;
+	uint8_t max;
+	void (*save)(void);
+} menuItem_t;
+
+#define MENU_OFF	0
+#define MENU_BROWSE	1	// Showing the label of menuIndex
+#define MENU_EDIT	2
+
+uint8_t menuState=MENU_OFF;
+uint8_t menuIndex;
+uint8_t menuValue;
+uint16_t menuTime;
+
+
+
+//
+// Show up to six characters, blanking the rest of the display
+//
+void ShowMsg_P(PGM_P msg) {
+	RenderText_P(seg, msg);
+	UpdateDisplay();
+}
 
-// Address for the RCT on the TWI-bus
-#define RTCADDR 0x6F
-
-
-// Locations in EEPROM
-#define EEPROM_THRESHOLD 	0
-#define EEPROM_LEVEL 		1
-
-
-// Delay macros tuned for 8MHz
-#define DLY1MS		_delay_loop_2(2000)
-#define DLY10MS		_delay_loop_2(20000)
-#define DLY100MS	for (uint8_t dly100MS=0; dly100MS<10; dly100MS++,DLY10MS)
-
-// macros for reading the state of the button
-#define ButtonPressed (!(PINC & 0x01))
-#define ButtonReleased ((PINC & 0x01))
-
-// Bitmaps for the 7-segment display
-#define DOT		0x80
-const uint8_t charmap[] = {
-	0,134,34,54,0,0,0,2,			//  !"#$%&'
-	57,31,0,0,0,64,128,82,			// ()*+,-./
-	63,6,91,79,102,109,125,7, 		// 01234567
-	127,111,0,0,0,0,0,0, 			// 89:;<=>?
-	0,119,124,88,94,121,113,61, 	// @ABCDEFG
-	116,48,30,117,56,55,84,92,		// HIJKLMNO
-	115,107,80,109,120,28,62,126, 	// PQRSTUVW
-	118,110,91,48,100,6,1,8			// XYZ[\]^_
-};
-
-const uint8_t digitmask[]={128,64,32,16,8,4};
-volatile uint8_t seg[6];
 
-volatile uint8_t second;
-volatile uint8_t minute;
-volatile uint8_t hour;
-volatile uint8_t brightness;
 
-uint8_t dimLevel;
-uint8_t brightnessThreshold;
+//
+// Render the local time, called by the clock as each second starts
+//
+void ShowTime(void) {
+	if (menuState!=MENU_OFF) return;
+	seg[5]=CHARMAP(16+BCD_ONES(second));
+	seg[4]=CHARMAP(16+BCD_TENS(second));
+	seg[3]=CHARMAP(16+BCD_ONES(minute)) | DOT;
+	seg[2]=CHARMAP(16+BCD_TENS(minute));
+	seg[1]=CHARMAP(16+BCD_ONES(hour)) | DOT;
+	seg[0]=CHARMAP(16+BCD_TENS(hour));
+	UpdateDisplay();
+}
 
 
 
 //
+// Brightness for a light reading in 1/256 levels, interpolated between
+// the points of the curve
 //
-//
-ISR(TIMER0_OVF_vect) {
-	static uint8_t digit;
-	static uint8_t dim;
+uint16_t LightToLevel(uint16_t light) {
+	uint8_t i, f;
+	int16_t y0, y1;
 
-	PORTB=0;
-	PORTD=digitmask[digit];
-	if (!dim) PORTB=seg[digit];
-
-	digit++;
-	if (digit>5) {
-		digit=0;
-		dim++;
-		if (dim>brightness) dim=0;
-	}
+	i=light>>CURVE_SHIFT;
+	f=light&((1<<CURVE_SHIFT)-1);
+	y0=brightnessCurve[i];
+	y1=brightnessCurve[i+1];
+	// (y1-y0)*f/128 levels is (y1-y0)*f*2 in 1/256 levels
+	return (y0<<8)+(y1-y0)*(f<<(8-CURVE_SHIFT));
 }
 
 
+
 //
+// Track the LDR with the display brightness
 //
-//
-uint16_t ReadADC(uint8_t channel) {
-   ADMUX |= channel;                // Channel selection
-   ADCSRA |= _BV(ADSC);               // Start conversion
-   while(!bit_is_set(ADCSRA,ADIF));   // Loop until conversion is complete
-   ADCSRA |= _BV(ADIF);               // Clear ADIF by writing a 1 (this sets the value to 0)
- 
-   return(ADC);
-}
-
+void SampleLDR(void) {
+	static uint16_t target;
+	static uint16_t level;
+	static uint8_t started;
+	uint16_t t;
+	int16_t d;
 
+#ifdef ADC_SLEEP
+	// A block taken in ADC sleep freezes the display for ~13ms, so it
+	// is only done every LDR_SLEEP_EVERY runs
+	static uint8_t skip;
 
+	if (skip==0) {
+		SampleLight();
+		skip=LDR_SLEEP_EVERY;
+	}
+	skip--;
+#endif
+	t=LightToLevel(GetLight());
+	d=t-target;
+	if (!started) {
+		target=level=t;
+		started=1;
+	} else if (d>BRIGHT_HYST || d<-BRIGHT_HYST) {
+		target=t;
+	}
 
-uint8_t ReadRTC(const uint8_t adr){
-  uint8_t data=0;
- 
-  beginTransmission(RTCADDR);
-  send(adr);
-  endTransmission();
-  requestFrom(RTCADDR,1);
-  while (available()) data=receive();
+	d=target-level;
+	if (d>BRIGHT_SLEW) d=BRIGHT_SLEW;
+	if (d<-BRIGHT_SLEW) d=-BRIGHT_SLEW;
+	level+=d;
 
-  return data;
+	t=(level+128)>>8;
+	if (t!=GetBrightness()) SetBrightness(t);
 }
 
 
-void WriteRTCByte(const uint8_t adr, const uint8_t data){
-  beginTransmission(RTCADDR);
-  send(adr);
-  send(data);
-  endTransmission();
-} 
 
-
-
-
-
-//
 //
+// Threshold and dim level are turned into a new brightness curve
 //
-void GetHMSfromRTC() {
-	uint8_t tmp;
+void SaveDimming(void) {
+	MakeCurve();
+	SaveSettings();
+}
 
-    tmp=ReadRTC(0);
-	second=(tmp&0x0f)+10*((tmp>>4)&0x07);
 
-    tmp=ReadRTC(1);
-	minute=(tmp&0x0f)+10*((tmp>>4)&0x07);
 
-    tmp=ReadRTC(2);
-	hour=(tmp&0x0f)+10*((tmp>>4)&0x03);
+//
+// Save the time items to the RTC. Hour, minute and second go together
+// so a rollover can't sneak in between the writes.
+//
+void SaveTime(void) {
+	WriteRTCTime(hour, minute, second);
+	ResyncClock();
 }
 
 
 
-
 //
 //
 //
-void ShowMsgDelay100ms(char *msg, uint8_t loops) {
-	uint8_t i;
-
-	for (i=0; i<6; i++) {
-		seg[i]=0;
-	}
-
-	for (i=0; (i<6) && (msg[i]>0); i++) {
-		seg[i]=charmap[msg[i]-32];
-	}
-
-	for (i=0; i<loops; i++) {
-		DLY100MS;
-	}
+void ZeroSeconds(void) {
+	second=0;
+	SaveTime();
 }
 
 
 
-void ScrollMessage(char *msg) {
-	uint8_t i;
-
-	for (i=0; msg[i]!=0; i++) {
-		ShowMsgDelay100ms(&msg[i], 2);
-	}
+static const char lblHour[] PROGMEM = "SET H";
+static const char lblMinute[] PROGMEM = "SET M";
+static const char lblZero[] PROGMEM = "ZERO S";
+static const char lblBright[] PROGMEM = "BRIGHT";
+static const char lblThresh[] PROGMEM = "THRESH";
+static const char lblLevel[] PROGMEM = "LEVEL";
+static const char lblPress[] PROGMEM = "PRESS";
+static const char lblLight[] PROGMEM = "BRI.";
 
-}
+const menuItem_t menu[] PROGMEM = {
+	{lblHour,	ITEM_BCD,	(uint8_t *)&hour,	0x00, 0x23, SaveTime},
+	{lblMinute,	ITEM_BCD,	(uint8_t *)&minute,	0x00, 0x59, SaveTime},
+	{lblZero,	ITEM_PRESS,	0,			0, 0, ZeroSeconds},
+	{lblBright,	ITEM_LIGHT,	0,			0, 0, 0},
+	{lblThresh,	ITEM_BIN,	&brightnessThreshold,	0x01, 0x99, SaveDimming},
+	{lblLevel,	ITEM_BIN,	&dimLevel,		0x00, 0x16, SaveDimming},
+};
+#define MENU_ITEMS	(sizeof(menu)/sizeof(menu[0]))
 
 
 
 //
+// Show a message with a BCD value in the two rightmost digits
 //
-//
-uint8_t Nybble(uint8_t v) {
-	uint8_t t;
-
-	t=16*((int)(v/10)) + v%10;
-	return t;
+void ShowValue_P(PGM_P msg, uint8_t value) {
+	ShowMsg_P(msg);
+	seg[5]=CHARMAP(16+BCD_ONES(value));
+	seg[4]=CHARMAP(16+BCD_TENS(value));
+	UpdateDisplay();
 }
 
 
 
 //
+// Show the label of the next item, or go back to the clock after the
+// last one
 //
-//
-void WaitForPress(void) {
-	uint16_t i;
-
-	ShowMsgDelay100ms("",5);
-	ShowMsgDelay100ms("PRESS",1);
-	for (i=0; i<10000; i++) {
-		DLY10MS;
-		if (ButtonPressed) return;
-	}
-	return;
-}
-
-
-
-uint8_t GetValue(uint8_t value, uint8_t valueMin, uint8_t valueMax) {
-	uint8_t i;
-
-	ShowMsgDelay100ms("",5);
-	for (;;) {
-		seg[5]=charmap[16+(value%10)];
-		seg[4]=charmap[16+(value/10)];
-		DLY100MS;
-		DLY100MS;
-		DLY100MS;
-		for (i=0; i<30; i++) {
-			DLY100MS;
-			if (ButtonPressed) break;
-		}
-		if (i>=30) break;
-		value++;
-		if (value>valueMax) value=valueMin;
+void NextItem(void) {
+	menuTime=GetMillis();
+	if (++menuIndex>=MENU_ITEMS) {
+		menuState=MENU_OFF;
+		ShowTime();
+		return;
 	}
-	return value;
+	menuState=MENU_BROWSE;
+	ShowMsg_P((PGM_P)pgm_read_ptr(&menu[menuIndex].label));
 }
 
 
 
-
 //
+// One step of the settings menu, run every MENU_TICK ms and on each
+// button event. Each label is shown for MENU_TIMEOUT ms and a press
+// selects it. A value is stepped by presses and auto-repeat, and is
+// saved when the button has been left alone for MENU_TIMEOUT ms.
 //
-//
-void HandleSettings() {
-	uint8_t i;
-	uint8_t v;
-
-
-	ShowMsgDelay100ms("",1);
-	while(ButtonPressed);
+void MenuTask(void) {
+	menuItem_t item;
+	uint8_t e;
+	uint8_t presses=0;
+	uint8_t steps=0;
+	uint16_t idle;
 
-	for (i=0; i<30; i++) {
-		ShowMsgDelay100ms("SET H", 1);
-		if (ButtonPressed) {
-			hour=GetValue(hour,0,23);
-			WriteRTCByte(2,Nybble(hour));    //HOUR
-			break;
-		}
+	while ((e=GetButtonEvent())!=BUTTON_NONE) {
+		if (e==BUTTON_PRESS) presses++;
+		if (e==BUTTON_PRESS || e==BUTTON_AUTOREPEAT) steps++;
 	}
-
-	for (i=0; i<30; i++) {
-		ShowMsgDelay100ms("SET M", 1);
-		if (ButtonPressed) {
-			minute=GetValue(minute,0,59);
-			WriteRTCByte(1,Nybble(minute));    //MINUTE
-			break;
+	if (steps) menuTime=GetMillis();
+	idle=GetMillis()-menuTime;
+
+	if (menuState==MENU_OFF) {
+		if (presses) {
+			StopAnim();
+			menuIndex=0xff;
+			NextItem();
 		}
+		return;
 	}
 
-	for (i=0; i<30; i++) {
-		ShowMsgDelay100ms("ZERO S", 1);
-		if (ButtonPressed) {
-			WaitForPress();
-			WriteRTCByte(0,0x80);    //START RTC, SECOND=00
-			break;
+	memcpy_P(&item, &menu[menuIndex], sizeof(item));
+
+	if (menuState==MENU_BROWSE) {
+		if (presses) {
+			menuState=MENU_EDIT;
+			if (item.kind==ITEM_BCD) menuValue=*item.var;
+			if (item.kind==ITEM_BIN) menuValue=BinToBcd(*item.var);
+			if (item.kind==ITEM_PRESS) {
+				ShowMsg_P(lblPress);
+			} else if (item.kind!=ITEM_LIGHT) {
+				ShowValue_P(PSTR(""), menuValue);
+			}
+		} else if (idle>=MENU_TIMEOUT) {
+			NextItem();
 		}
+		return;
 	}
 
-
-	for (i=0; i<30; i++) {
-		ShowMsgDelay100ms("BRIGHT", 1);
-		if (ButtonPressed) {
-			ShowMsgDelay100ms("BRI.",2);
-			for (;;) {
-				DLY100MS;
-				v=ReadADC(3)/10;
-				seg[5]=charmap[16+(v%10)];
-				seg[4]=charmap[16+(v/10)];
-				if (ButtonPressed) break;
+	switch (item.kind) {
+		case ITEM_BCD:
+		case ITEM_BIN:
+			if (idle>=MENU_TIMEOUT) {
+				*item.var = (item.kind==ITEM_BIN) ? BcdToBin(menuValue) : menuValue;
+				item.save();
+				NextItem();
+				break;
 			}
-			ShowMsgDelay100ms("",2);
+			while (steps--) menuValue=BcdIncWrap(menuValue, item.min, item.max);
+			ShowValue_P(PSTR(""), menuValue);
 			break;
-		}
-	}
 
-
-	for (i=0; i<30; i++) {
-		ShowMsgDelay100ms("THRESH", 1);
-		if (ButtonPressed) {
-			dimLevel=GetValue(brightnessThreshold,0,99);
-			eeprom_write_byte((uint8_t *)EEPROM_THRESHOLD, brightnessThreshold);
+		case ITEM_PRESS:
+			if (presses) item.save();
+			if (presses || idle>=MENU_WAIT) NextItem();
 			break;
-		}
-	}
 
-	for (i=0; i<30; i++) {
-		ShowMsgDelay100ms("LEVEL", 1);
-		if (ButtonPressed) {
-			dimLevel=GetValue(dimLevel,0,20);
-			eeprom_write_byte((uint8_t *)EEPROM_LEVEL, dimLevel);
+		case ITEM_LIGHT:
+			if (presses || idle>=MENU_WAIT) {
+				NextItem();
+				break;
+			}
+			e=LIGHT_DIV10(GetLight());
+			if (e>99) e=99;
+			ShowValue_P(lblLight, BinToBcd(e));
 			break;
-		}
 	}
-
-}
-
-
-
-//
-//
-//
-void AttractMode() {
-	uint8_t i;
-
-	srand(ReadADC(3));
-	for (i=0; i<255; i++) {
-			seg[rand()%6] ^= (1<<(rand()%7));
-			DLY10MS;
-			DLY10MS;
-	}		
-
-	ScrollMessage("     3ICLOCK R1.1     ");
 }
 
 
@@ -362,70 +361,58 @@ void AttractMode() {
 //
 //
 int main() { 
-	uint8_t light;
-
 	DDRB=0b11111111;	// Segment drivers PB0..PB7 as output 
 	PORTB=0;
 	DDRD=0b11111100; 	// Digit drivers PD2..PD7 as output
-	PORTD=0;
+	PORTD=0b00000011;	// Pull-ups on RXD/TXD
 	DDRC=0b00000000;	// All input on PORTC
 	PORTC=0b00000001;	// Pullup on BUTTON only
 
-	//Enable ADC and set 128 prescale
-    ADCSRA = _BV(ADEN) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0); 
+	// Stop the clock to the peripherals that aren't used
+	power_usart0_disable();	// Until the console starts it
+	power_spi_disable();
+	power_timer1_disable();
+	power_timer2_disable();
+	ACSR=_BV(ACD);		// Analog comparator off
 
-	// Set Timer0 prescale rate
-	TCCR0B |= _BV(CS01);
-	// Enable Timer Overflow Interrupts 
-	TIMSK0 |= _BV(TOIE0);
+	set_sleep_mode(SLEEP_MODE_IDLE);
+
+	InitADC();
+
+	InitDisplay();
 	sei();
 
 	begin();		// Initialize i2C
+	twi_setFrequency(TWI_FREQ_FAST);	// The MCP79410 handles 400kHz
 
 #ifdef SETTIME
-	WriteRTCByte(0,0);       //STOP RTC
-	WriteRTCByte(1,0x45);    //MINUTE=09
-	WriteRTCByte(2,0x13);    //HOUR=13
-	WriteRTCByte(3,0x09);    //DAY=5(SUNDAY) AND VBAT=1
-	WriteRTCByte(4,0x03);    //DATE=02
-	WriteRTCByte(5,0x06);    //MONTH=06
-	WriteRTCByte(6,0x12);    //YEAR=12
-	WriteRTCByte(0,0x80);    //START RTC, SECOND=00
+	{
+		const uint8_t t[RTC_TIMEREGS] = {
+			0x80,    //START RTC, SECOND=00
+			0x45,    //MINUTE=45
+			0x13,    //HOUR=13
+			0x09,    //DAY=1 AND VBAT=1
+			0x03,    //DATE=03
+			0x06,    //MONTH=06
+			0x12     //YEAR=12
+		};
+		WriteRTCBlock(RTC_SECONDS, t, RTC_TIMEREGS);
+	}
 #endif
 
 
-	// Read stored settings from EEPROM
-	brightnessThreshold = eeprom_read_byte((uint8_t *)EEPROM_THRESHOLD);
-	if (brightnessThreshold<1) brightnessThreshold=50;
-	if (brightnessThreshold>99) brightnessThreshold=50;
-	dimLevel = eeprom_read_byte((uint8_t *)EEPROM_LEVEL);
-	if (dimLevel>16) dimLevel=16;
-
-	AttractMode();
+	LoadSettings();
 
+	// The boot animation runs on top of the clock
+	SeedRandom(GetLight());
+	StartClock(ShowTime);
+	StartAnim(ATTRACT_FRAMES, PSTR("     3ICLOCK R1.1     "));
+	AddTask(SampleLDR, 0, LDR_PERIOD);
+	InitButton(AddTask(MenuTask, 0, MENU_TICK));
+	StartConsole();
 
 	for(;;) {
-		if (ButtonPressed) {
-			HandleSettings();
-		}
-
-		GetHMSfromRTC();
-		seg[5]=charmap[16+(second%10)];
-		seg[4]=charmap[16+(second/10)];
-		seg[3]=charmap[16+(minute%10)] | DOT;
-		seg[2]=charmap[16+(minute/10)];
-		seg[1]=charmap[16+(hour%10)] | DOT;
-		seg[0]=charmap[16+(hour/10)];
-
-		if (second%2==0) {
-			light=ReadADC(3)/10;
-			if (light>brightnessThreshold) {
-				brightness=0;
-			} else {
-				brightness=dimLevel;
-			}
-		}
-		DLY100MS;
+		RunTasks();
 	}
 } 
 
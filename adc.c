@@ -0,0 +1,107 @@
+//
+//	adc.c - Background acquisition of the LDR value
+//
+//    Conversions are started by the hardware (auto-trigger from Timer0)
+//    and collected in the ADC-complete interrupt. Each block of
+//    2^ADC_OVERSAMPLE_SHIFT samples is summed and fed through a first
+//    order IIR filter, so reading the light level is just a copy.
+//
+//    With ADC_SLEEP defined the auto-trigger is not used. Instead the
+//    samples are taken by SampleLight() in ADC Noise Reduction sleep,
+//    which stops the display multiplexing for the ~200us each conversion
+//    takes but gives a quieter reading.
+//
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <util/atomic.h>
+
+#include "hal.h"
+#include "adc.h"
+
+// Sum of the samples in the block being collected
+static uint16_t adcSum;
+static uint8_t adcCount;
+
+// Filtered value, scaled by 2^ADC_OVERSAMPLE_SHIFT
+static volatile uint16_t adcFiltered;
+
+// Number of blocks completed, wraps freely
+static volatile uint8_t adcBlocks;
+
+
+
+//
+//
+//
+ISR(ADC_vect) {
+	adcSum+=ADC;
+	adcCount++;
+	if (adcCount==(1<<ADC_OVERSAMPLE_SHIFT)) {
+		adcFiltered+=(adcSum>>ADC_IIR_SHIFT)-(adcFiltered>>ADC_IIR_SHIFT);
+		adcSum=0;
+		adcCount=0;
+		adcBlocks++;
+	}
+}
+
+
+
+//
+// Set up the ADC for the LDR channel and seed the filter with a single
+// blocking conversion so the first readings are meaningful.
+//
+void InitADC(void) {
+	ADMUX=(ADMUX & 0xf0) | LDR_CHANNEL;		// Channel selection
+	DIDR0=_BV(LDR_CHANNEL);				// No digital input buffer on the LDR pin
+
+	//Enable ADC and set 128 prescale
+	ADCSRA=_BV(ADEN) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+
+	ADCSRA|=_BV(ADSC);				// Start conversion
+	while(!bit_is_set(ADCSRA,ADIF)) HAL_IDLE();	// Loop until conversion is complete
+	ADCSRA|=_BV(ADIF);				// Clear ADIF by writing a 1
+	adcFiltered=ADC<<ADC_OVERSAMPLE_SHIFT;
+
+#ifdef ADC_SLEEP
+	ADCSRA|=_BV(ADIE);
+#else
+	ADCSRB=ADC_TRIGGER;
+	ADCSRA|=_BV(ADATE) | _BV(ADIE);
+#endif
+}
+
+
+
+//
+// Filtered LDR value on the 0..1023 scale
+//
+uint16_t GetLight(void) {
+	uint16_t v;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		v=adcFiltered;
+	}
+	return v>>ADC_OVERSAMPLE_SHIFT;
+}
+
+
+
+#ifdef ADC_SLEEP
+//
+// Collect one full block of samples using ADC Noise Reduction sleep.
+// Entering the sleep mode starts a conversion and the ADC interrupt
+// wakes the CPU again when it is done. Other wakeups (TWI) just start
+// another conversion.
+//
+void SampleLight(void) {
+	uint8_t block=adcBlocks;
+
+	set_sleep_mode(SLEEP_MODE_ADC);
+	while (block==adcBlocks) {
+		sleep_mode();
+	}
+	set_sleep_mode(SLEEP_MODE_IDLE);
+}
+#endif
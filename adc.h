@@ -0,0 +1,30 @@
+#ifndef ADC_H
+#define ADC_H
+
+#include <stdint.h>
+
+// ADC channel the LDR is connected to
+#define LDR_CHANNEL		3
+
+// Number of conversions summed into each oversampled block (as a power
+// of two) and the time constant of the IIR filter run on the blocks
+#define ADC_OVERSAMPLE_SHIFT	6
+#define ADC_IIR_SHIFT		4
+
+// Auto-trigger source for the conversions (ADTS2:0 in ADCSRB),
+// 3 is Timer/Counter0 Compare Match A, the start of each digit slot
+#ifndef ADC_TRIGGER
+#define ADC_TRIGGER		3
+#endif
+
+// Light value scaled to 0..102 as used by the settings, x*205/2048
+// equals x/10 for every 10-bit x and needs no divide
+#define LIGHT_DIV10(x)	((uint8_t)(((uint32_t)(x)*205)>>11))
+
+void InitADC(void);
+uint16_t GetLight(void);
+#ifdef ADC_SLEEP
+void SampleLight(void);
+#endif
+
+#endif
@@ -0,0 +1,148 @@
+//
+//	anim.c - Display animations drawn on the overlay layer
+//
+//    An animation runs as a task that draws one frame every ANIM_TICK
+//    ms into the display overlay, so the clock or menu underneath keeps
+//    updating. It goes through up to three phases:
+//
+//      sparkle  random segments are flipped on top of the picture
+//      scroll   a message is scrolled across, covering the picture
+//      fade     the overlay dissolves a few random segments at a time,
+//               crossfading back to the picture underneath
+//
+
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+
+#include "display.h"
+#include "sched.h"
+#include "anim.h"
+
+#define ANIM_IDLE	0
+#define ANIM_SPARKLE	1
+#define ANIM_SCROLL	2
+#define ANIM_FADE	3
+
+static uint16_t rnd=1;			// xorshift state, never 0
+
+static uint8_t animTask=NO_TASK;
+static uint8_t phase=ANIM_IDLE;
+static uint8_t frames;			// Left in this phase or scroll step
+static PGM_P scrollMsg;
+static uint8_t scrollPos;
+
+
+
+//
+// Seed the generator, 0 is not a valid state and is ignored
+//
+void SeedRandom(uint16_t seed) {
+	if (seed) rnd=seed;
+}
+
+
+
+//
+// 16 bit xorshift (7,9,8), period 65535
+//
+uint8_t Random(void) {
+	rnd^=rnd<<7;
+	rnd^=rnd>>9;
+	rnd^=rnd<<8;
+	return rnd;
+}
+
+
+
+//
+//
+//
+static void StartPhase(uint8_t p) {
+	phase=p;
+	if (p==ANIM_SCROLL) {
+		scrollPos=0;
+		frames=1;
+	} else {
+		frames=FADE_FRAMES;
+	}
+}
+
+
+
+//
+// Draw the next frame
+//
+static void AnimTask(void) {
+	uint8_t i, keep;
+
+	switch (phase) {
+		case ANIM_SPARKLE:
+			i=Random()%DIGITS;
+			overlay[i]^=1<<(Random()%7);
+			if (--frames==0) StartPhase(scrollMsg ? ANIM_SCROLL : ANIM_FADE);
+			break;
+
+		case ANIM_SCROLL:
+			if (--frames) return;
+			frames=SCROLL_FRAMES;
+			if (!pgm_read_byte(&scrollMsg[scrollPos])) {
+				StartPhase(ANIM_FADE);
+				break;
+			}
+			RenderText_P(overlay, &scrollMsg[scrollPos++]);
+			for (i=0; i<DIGITS; i++) overlayMask[i]=0xff;
+			break;
+
+		case ANIM_FADE:
+			// Each segment is kept with a 3/4 chance per frame
+			keep=0;
+			for (i=0; i<DIGITS; i++) {
+				if (frames>1) keep=Random()|Random();
+				overlay[i]&=keep;
+				overlayMask[i]&=keep;
+			}
+			if (--frames==0) {
+				phase=ANIM_IDLE;
+				StopTask(animTask);
+				animTask=NO_TASK;
+			}
+			break;
+	}
+	UpdateDisplay();
+}
+
+
+
+//
+// Flip a random segment on each of the next sparkles frames, then
+// scroll msg across if it isn't 0, then fade back to the picture
+//
+void StartAnim(uint8_t sparkles, PGM_P msg) {
+	StopAnim();
+	scrollMsg=msg;
+	if (sparkles) {
+		phase=ANIM_SPARKLE;
+		frames=sparkles;
+	} else {
+		StartPhase(msg ? ANIM_SCROLL : ANIM_FADE);
+	}
+	animTask=AddTask(AnimTask, 0, ANIM_TICK);
+}
+
+
+
+//
+// End any animation and clear the overlay at once
+//
+void StopAnim(void) {
+	uint8_t i;
+
+	StopTask(animTask);
+	animTask=NO_TASK;
+	phase=ANIM_IDLE;
+	for (i=0; i<DIGITS; i++) {
+		overlay[i]=0;
+		overlayMask[i]=0;
+	}
+	UpdateDisplay();
+}
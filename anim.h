@@ -0,0 +1,19 @@
+#ifndef ANIM_H
+#define ANIM_H
+
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+// Time per animation frame and frames per scroll step, in ms and frames
+#define ANIM_TICK		20
+#define SCROLL_FRAMES		10
+
+// Most frames spent fading the overlay out
+#define FADE_FRAMES		32
+
+void SeedRandom(uint16_t seed);
+uint8_t Random(void);
+void StartAnim(uint8_t sparkles, PGM_P msg);
+void StopAnim(void);
+
+#endif
@@ -0,0 +1,56 @@
+//
+//	bcd.c - Packed BCD helpers
+//
+//    The time is kept in BCD, as the RTC stores it, so that each digit
+//    can be looked up in charmap without dividing. The ATmega has no
+//    divide instruction and the library divide takes ~70 cycles.
+//    Comparisons work directly on valid BCD values since the order is
+//    the same as for the binary value.
+//
+
+#include "bcd.h"
+
+
+
+//
+// Add one, 0x09 becomes 0x10 and 0x99 becomes 0xa0
+//
+uint8_t BcdInc(uint8_t v) {
+	if (BCD_ONES(v)==9) return v+7;
+	return v+1;
+}
+
+
+
+//
+// Add one, going back to min after max
+//
+uint8_t BcdIncWrap(uint8_t v, uint8_t min, uint8_t max) {
+	v=BcdInc(v);
+	if (v>max) v=min;
+	return v;
+}
+
+
+
+//
+// Convert 0..99 to BCD by repeated subtraction, at most nine rounds
+//
+uint8_t BinToBcd(uint8_t v) {
+	uint8_t t=0;
+
+	while (v>=10) {
+		v-=10;
+		t+=0x10;
+	}
+	return t|v;
+}
+
+
+
+//
+//
+//
+uint8_t BcdToBin(uint8_t v) {
+	return BCD_TENS(v)*10+BCD_ONES(v);
+}
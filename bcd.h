@@ -0,0 +1,15 @@
+#ifndef BCD_H
+#define BCD_H
+
+#include <stdint.h>
+
+// Tens and ones digit of a packed BCD byte
+#define BCD_TENS(v)	((v)>>4)
+#define BCD_ONES(v)	((v)&0x0f)
+
+uint8_t BcdInc(uint8_t v);
+uint8_t BcdIncWrap(uint8_t v, uint8_t min, uint8_t max);
+uint8_t BinToBcd(uint8_t v);
+uint8_t BcdToBin(uint8_t v);
+
+#endif
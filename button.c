@@ -0,0 +1,100 @@
+//
+//	button.c - Debounced button with press, release, long-press and
+//	           auto-repeat events
+//
+//    SampleButton() is called from the display interrupt every
+//    BUTTON_TICK ms, so the button is watched while the CPU sleeps or
+//    is busy elsewhere. A pin change interrupt (PCINT8, which could
+//    share PCINT1_vect with the MFP input) would fire on every contact
+//    bounce and still need a time base to debounce and to time long
+//    presses and repeats, so the tick does all of it. Events are put
+//    in a small queue and the task given to InitButton() is woken for
+//    each one. The UI reads them with GetButtonEvent().
+//
+
+#include <avr/io.h>
+
+#include "sched.h"
+#include "button.h"
+
+#define TICKS(ms)	((ms)/BUTTON_TICK)
+
+static volatile uint8_t queue[BUTTON_QUEUE];
+static volatile uint8_t queueHead;
+static volatile uint8_t queueTail;
+
+static uint8_t eventTask=NO_TASK;
+static uint8_t down;			// Debounced state
+static uint8_t count;			// Samples the raw state has differed
+static uint8_t held;			// Ticks until the next long/repeat event
+static uint8_t repeating;
+
+
+
+//
+// Queue an event, dropped when the queue is full
+//
+static void PostEvent(uint8_t event) {
+	uint8_t next;
+
+	next=(queueHead+1)%BUTTON_QUEUE;
+	if (next!=queueTail) {
+		queue[queueHead]=event;
+		queueHead=next;
+	}
+	WakeTask(eventTask);
+}
+
+
+
+//
+// Called from the tick interrupt every BUTTON_TICK ms
+//
+void SampleButton(void) {
+	uint8_t raw;
+
+	raw=!(PINC & (1<<BUTTON_PIN));
+	if (raw!=down) {
+		if (++count<BUTTON_DEBOUNCE) return;
+		count=0;
+		down=raw;
+		if (down) {
+			held=TICKS(BUTTON_LONG);
+			repeating=0;
+			PostEvent(BUTTON_PRESS);
+		} else {
+			PostEvent(BUTTON_RELEASE);
+		}
+		return;
+	}
+	count=0;
+
+	if (down && --held==0) {
+		held=TICKS(BUTTON_REPEAT);
+		PostEvent(repeating ? BUTTON_AUTOREPEAT : BUTTON_LONGPRESS);
+		repeating=1;
+	}
+}
+
+
+
+//
+// Wake task on each event, NO_TASK to just queue them
+//
+void InitButton(uint8_t task) {
+	eventTask=task;
+}
+
+
+
+//
+// Oldest queued event, or BUTTON_NONE
+//
+uint8_t GetButtonEvent(void) {
+	uint8_t event;
+
+	if (queueHead==queueTail) return BUTTON_NONE;
+	event=queue[queueTail];
+	queueTail=(queueTail+1)%BUTTON_QUEUE;
+	return event;
+}
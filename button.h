@@ -0,0 +1,30 @@
+#ifndef BUTTON_H
+#define BUTTON_H
+
+#include <stdint.h>
+
+// The button is on PC0 and pulls the pin low when pressed
+#define BUTTON_PIN	0
+
+// Sampling interval and the timings, in ms. The button has to read the
+// same for BUTTON_DEBOUNCE samples in a row before a change is taken.
+#define BUTTON_TICK		4
+#define BUTTON_DEBOUNCE		4
+#define BUTTON_LONG		800
+#define BUTTON_REPEAT		150
+
+// Button events
+#define BUTTON_NONE	0
+#define BUTTON_PRESS	1
+#define BUTTON_RELEASE	2
+#define BUTTON_LONGPRESS	3	// Held for BUTTON_LONG ms
+#define BUTTON_AUTOREPEAT	4	// Every BUTTON_REPEAT ms after that
+
+// Number of events held until they are read
+#define BUTTON_QUEUE	4
+
+void InitButton(uint8_t task);
+void SampleButton(void);
+uint8_t GetButtonEvent(void);
+
+#endif
@@ -0,0 +1,310 @@
+//
+//	console.c - Command line and telemetry on the serial port
+//
+//    The line task is woken by the receive interrupt at each CR or LF
+//    and also runs every CONSOLE_PERIOD ms in case a wake-up is missed.
+//    It collects the received bytes into a line and executes it. The
+//    commands are kept short so a host can set up a clock with a couple
+//    of lines, see console.h for the protocol.
+//
+
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+
+#include "twi.h"
+#include "rtc.h"
+#include "adc.h"
+#include "display.h"
+#include "sched.h"
+#include "swclock.h"
+#include "settings.h"
+#include "uart.h"
+#include "console.h"
+
+// Fallback polling of the RX ring, ms
+#define CONSOLE_PERIOD		200
+
+// Longest command line, excluding the line end
+#define LINE_LENGTH		8
+
+// Bytes shown by the E command
+#define EEDUMP_LENGTH		8
+
+static const char msgOk[] PROGMEM = "OK\r\n";
+static const char msgErr[] PROGMEM = "ERR\r\n";
+static const char msgUnknown[] PROGMEM = "?\r\n";
+static const char msgEol[] PROGMEM = "\r\n";
+
+static char line[LINE_LENGTH];
+static uint8_t lineLength;
+static uint8_t lineOverflow;
+static uint8_t telemetry;
+static uint16_t lastPasses;
+
+
+
+//
+// Value of a hex digit, or 0xff
+//
+static uint8_t HexDigit(char c) {
+	if (c>='0' && c<='9') return c-'0';
+	if (c>='A' && c<='F') return c-'A'+10;
+	if (c>='a' && c<='f') return c-'a'+10;
+	return 0xff;
+}
+
+
+
+//
+// Two hex digits as a byte, *ok is cleared if they aren't valid
+//
+static uint8_t ParseHex(const char *p, uint8_t *ok) {
+	uint8_t hi, lo;
+
+	hi=HexDigit(p[0]);
+	lo=HexDigit(p[1]);
+	if ((hi|lo)&0xf0) {
+		*ok=0;
+		return 0;
+	}
+	return (hi<<4)|lo;
+}
+
+
+
+//
+// Two decimal digits as packed BCD, *ok is cleared unless they are
+// valid and below max
+//
+static uint8_t ParseBcd(const char *p, uint8_t max, uint8_t *ok) {
+	uint8_t v;
+
+	v=ParseHex(p, ok);
+	if ((v&0x0f)>9 || v>=max) *ok=0;
+	return v;
+}
+
+
+
+//
+//
+//
+static void PutHex16(uint16_t v) {
+	UartPutHex(v>>8);
+	UartPutHex(v);
+}
+
+
+
+//
+// T and Thhmmss
+//
+static void CmdTime(void) {
+	uint8_t ok=1;
+	uint8_t h, m, s;
+
+	if (lineLength==1) {
+		UartPutc('T');
+		UartPutc(' ');
+		UartPutHex(hour);
+		UartPutHex(minute);
+		UartPutHex(second);
+		UartPuts_P(msgEol);
+		return;
+	}
+	h=ParseBcd(&line[1], 0x24, &ok);
+	m=ParseBcd(&line[3], 0x60, &ok);
+	s=ParseBcd(&line[5], 0x60, &ok);
+	if (lineLength!=7 || !ok || WriteRTCTime(h, m, s)!=TWI_OK) {
+		UartPuts_P(msgErr);
+		return;
+	}
+	ResyncClock();
+	UartPuts_P(msgOk);
+}
+
+
+
+//
+// S
+//
+static void CmdSettings(void) {
+	UartPutc('S');
+	UartPutc(' ');
+	UartPutHex(brightnessThreshold);
+	UartPutHex(dimLevel);
+	UartPuts_P(msgEol);
+}
+
+
+
+//
+// Eaa
+//
+static void CmdEeprom(void) {
+	uint8_t ok=1;
+	uint8_t adr, i;
+
+	// The EEPROM interrupt of a settings write would get between the
+	// address and the strobe of a read
+	adr=ParseHex(&line[1], &ok);
+	if (lineLength!=3 || !ok || adr>E2END-EEDUMP_LENGTH+1 || SettingsBusy()) {
+		UartPuts_P(msgErr);
+		return;
+	}
+	UartPutc('E');
+	UartPutc(' ');
+	UartPutHex(adr);
+	UartPutc(' ');
+	for (i=0; i<EEDUMP_LENGTH; i++) {
+		UartPutHex(eeprom_read_byte((uint8_t *)(uintptr_t)(adr+i)));
+	}
+	UartPuts_P(msgEol);
+}
+
+
+
+//
+// C and Ckkvv, read the brightness curve or set point kk to level vv
+//
+static void CmdCurve(void) {
+	uint8_t ok=1;
+	uint8_t k, v;
+
+	if (lineLength==1) {
+		UartPutc('C');
+		UartPutc(' ');
+		for (k=0; k<CURVE_POINTS; k++) {
+			UartPutHex(brightnessCurve[k]);
+		}
+		UartPuts_P(msgEol);
+		return;
+	}
+	k=ParseHex(&line[1], &ok);
+	v=ParseHex(&line[3], &ok);
+	if (lineLength!=5 || !ok || k>=CURVE_POINTS || v>BRIGHT_MAX) {
+		UartPuts_P(msgErr);
+		return;
+	}
+	brightnessCurve[k]=v;
+	SaveSettings();
+	UartPuts_P(msgOk);
+}
+
+
+
+//
+// M0 and M1
+//
+static void CmdTelemetry(void) {
+	uint8_t busy, isr;
+
+	if (lineLength!=2 || (line[1]!='0' && line[1]!='1')) {
+		UartPuts_P(msgErr);
+		return;
+	}
+	telemetry=line[1]-'0';
+	lastPasses=schedPasses;
+	displayLatencyMax=0;
+	displayIsrMax=0;
+	GetCpuLoad(&busy, &isr);		// Start a new load window
+	UartPuts_P(msgOk);
+}
+
+
+
+//
+//
+//
+static void Execute(void) {
+	switch (line[0]) {
+		case 'T': CmdTime(); break;
+		case 'S': CmdSettings(); break;
+		case 'E': CmdEeprom(); break;
+		case 'C': CmdCurve(); break;
+		case 'M': CmdTelemetry(); break;
+		default: UartPuts_P(msgUnknown); break;
+	}
+}
+
+
+
+//
+// Collect received bytes and run each complete line. Overlong lines
+// are answered with ERR once the line end arrives.
+//
+static void LineTask(void) {
+	int16_t c;
+
+	while ((c=UartGetc())!=UART_NONE) {
+		if (c=='\r' || c=='\n') {
+			if (lineOverflow) {
+				UartPuts_P(msgErr);
+			} else if (lineLength) {
+				Execute();
+			}
+			lineLength=0;
+			lineOverflow=0;
+		} else if (lineLength<LINE_LENGTH) {
+			line[lineLength++]=c;
+		} else {
+			lineOverflow=1;
+		}
+	}
+}
+
+
+
+//
+//
+//
+static void TelemetryTask(void) {
+	uint16_t passes;
+	uint8_t latency;
+	uint8_t isrMax;
+	uint8_t busy, isr;
+
+	if (!telemetry) return;
+
+	passes=schedPasses;
+	latency=displayLatencyMax;
+	displayLatencyMax=0;
+	isrMax=displayIsrMax;
+	displayIsrMax=0;
+	GetCpuLoad(&busy, &isr);
+
+	UartPutc('D');
+	UartPutc(' ');
+	PutHex16(GetLight());
+	UartPutc(' ');
+	UartPutHex(GetBrightness());
+	UartPutc(' ');
+	PutHex16(twi_getErrorCount());
+	UartPutc(' ');
+	PutHex16(clockResyncs);
+	UartPutc(' ');
+	PutHex16(clockDrift);
+	UartPutc(' ');
+	PutHex16(passes-lastPasses);
+	UartPutc(' ');
+	UartPutHex(latency);
+	UartPutc(' ');
+	UartPutHex(isrMax);
+	UartPutc(' ');
+	UartPutHex(busy);
+	UartPutc(' ');
+	UartPutHex(isr);
+	UartPuts_P(msgEol);
+	lastPasses=passes;
+}
+
+
+
+//
+//
+//
+void StartConsole(void) {
+	InitUART(AddTask(LineTask, 0, CONSOLE_PERIOD));
+	AddTask(TelemetryTask, TELEMETRY_PERIOD, TELEMETRY_PERIOD);
+}
@@ -0,0 +1,30 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+// Line protocol on the USART, one command per line, ended by CR or LF.
+// Replies are one line each, numbers in hex except the time.
+//
+//   T          read the time         -> T hhmmss
+//   Thhmmss    set the time          -> OK | ERR
+//   S          read the settings     -> S ttll  (threshold, level)
+//   Eaa        dump 8 EEPROM bytes   -> E aa xxxxxxxxxxxxxxxx
+//                                       | ERR while settings are saved
+//   C          read the light curve  -> C xxxxxxxxxxxxxxxxxx (9 levels)
+//   Ckkvv      set curve point kk    -> OK | ERR
+//   M1 / M0    telemetry on / off    -> OK
+//
+// With telemetry on, a line is sent every TELEMETRY_PERIOD ms:
+//
+//   D llll bb eeee rrrr dddd pppp aa ii cc dd
+//
+// LDR value, display brightness, TWI errors, RTC resyncs, clock drift in ms,
+// scheduler passes since the last line, the longest display interrupt
+// entry latency and end time in Timer0 ticks, and the percentage of
+// time the main loop was busy and spent in the display interrupt, all
+// since the last line.
+
+#define TELEMETRY_PERIOD	1000
+
+void StartConsole(void);
+
+#endif
@@ -0,0 +1,314 @@
+//
+//	display.c - Multiplexing and brightness control of the 7-segment display
+//
+//    Timer0 runs in CTC mode. Compare Match A starts each digit slot and
+//    Compare Match B ends it, so the brightness is set by how far into
+//    the slot OCR0B is placed. OCR0A sets the slot length, and with it
+//    the refresh rate, from DISPLAY_FPS.
+//    Every digit is lit in every frame regardless of brightness, keeping
+//    the refresh rate constant. The levels go through a gamma table so
+//    the steps look even to the eye.
+//
+//    With DISPLAY_COMPENSATE the on-time of each digit is also scaled by
+//    the number of segments it has lit, so a "1" isn't brighter than an
+//    "8". This is done when the frame is built; the interrupt just loads
+//    the per-digit OCR0B value as before.
+//
+//    The interrupt never looks at seg[]. UpdateDisplay() turns it into
+//    the final PORTB/PORTD/OCR0B values for each slot in a back buffer,
+//    and the interrupt switches to that buffer when it starts the next
+//    frame, so a half-written time is never shown.
+//
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+
+#include "display.h"
+#include "sched.h"
+#include "button.h"
+
+// Cycles from Compare Match A to the TCNT0 check in its interrupt when
+// nothing holds it up: wake-up and vector about 11, prologue about 30,
+// latency sample, buffer swap and slot lookup about 38, port writes and
+// the check about 9. Estimated by hand from the -Os code, recount from
+// 3iClock.lss when the interrupt changes.
+#define LIGHT_CYCLES	96
+
+// Shortest on-time in Timer0 ticks, so the check normally finds the
+// compare still ahead and the digit is lit
+#define MIN_ONTIME	(LIGHT_CYCLES/DISPLAY_PRESCALE+1)
+
+// Longest on-time. With OCR0B equal to OCR0A both compare matches come
+// on the same tick, and Compare Match B would blank the digit that
+// Compare Match A has just lit.
+#define MAX_ONTIME	(SLOT_TICKS-2)
+
+#if DISPLAY_PRESCALE==8
+#define DISPLAY_CS	_BV(CS01)
+#else
+#define DISPLAY_CS	(_BV(CS01) | _BV(CS00))
+#endif
+
+// On-time for each brightness level in 1/256 of a slot, gamma 2.2. It
+// is scaled to SLOT_TICKS when the frame is built, and kept between
+// MIN_ONTIME and MAX_ONTIME.
+static const uint8_t gammaTable[BRIGHT_MAX+1] PROGMEM = {
+	  0,  1,  1,  1,  1,  1,  1,  2,
+	  3,  4,  4,  5,  7,  8,  9, 11,
+	 13, 14, 16, 18, 20, 23, 25, 28,
+	 31, 33, 36, 40, 43, 46, 50, 54,
+	 57, 61, 66, 70, 74, 79, 84, 89,
+	 94, 99,105,110,116,122,128,134,
+	140,147,153,160,167,174,182,189,
+	197,205,213,221,229,238,246,255
+};
+
+static const uint8_t digitmask[DIGITS] PROGMEM={128,64,32,16,8,4};
+
+#ifdef DISPLAY_COMPENSATE
+// On-time in 1/256 of the brightness setting for a digit with 0..8 lit
+// segments. The segments of a digit share its driver, so each one gets
+// less current the more are lit, taken as about 8% less per extra
+// segment: (1+0.08*(n-1))/(1+0.08*7). A full "8." is not reduced.
+static const uint8_t segmentOnTime[9] PROGMEM = {
+	255, 164, 177, 190, 203, 217, 230, 243, 255
+};
+
+// Lit segments in each nibble
+static const uint8_t nibbleBits[16] PROGMEM = {
+	0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4
+};
+#endif
+
+// Keep the pull-ups on PD0/RXD and PD1/TXD while driving the digits
+#define PORTD_PULLUPS	0x03
+
+uint8_t seg[DIGITS];
+
+// Register values for one digit slot
+typedef struct {
+	uint8_t portb;
+	uint8_t portd;
+	uint8_t ocr;
+} slot_t;
+
+static slot_t frame[2][DIGITS];
+static volatile uint8_t front;
+static volatile uint8_t swapPending;
+
+static uint8_t brightness;
+
+volatile uint8_t displayLatencyMax;
+volatile uint8_t displayIsrMax;
+
+// CPU load sampling: slots counted, slots that found the main loop
+// busy, and Timer0 ticks spent in the slot interrupt
+static volatile uint16_t loadSlots;
+static volatile uint16_t loadBusy;
+static volatile uint32_t loadIsrTicks;
+
+uint8_t overlay[DIGITS];
+uint8_t overlayMask[DIGITS];
+
+const uint8_t charmap[] PROGMEM = {
+	0,134,34,54,0,0,0,2,			//  !"#$%&'
+	57,31,0,0,0,64,128,82,			// ()*+,-./
+	63,6,91,79,102,109,125,7, 		// 01234567
+	127,111,0,0,0,0,0,0, 			// 89:;<=>?
+	0,119,124,88,94,121,113,61, 	// @ABCDEFG
+	116,48,30,117,56,55,84,92,		// HIJKLMNO
+	115,107,80,109,120,28,62,126, 	// PQRSTUVW
+	118,110,91,48,100,6,1,8			// XYZ[\]^_
+};
+
+
+
+//
+// Start of a digit slot. Also keeps the millisecond tick by counting
+// the CPU cycles that have passed, samples the button on it, and
+// samples the CPU load.
+//
+ISR(TIMER0_COMPA_vect) {
+	static uint8_t digit;
+	static uint16_t cycles;
+	const slot_t *s;
+	uint8_t t;
+
+	t=TCNT0;
+	if (t>displayLatencyMax) displayLatencyMax=t;
+
+	if (digit==0 && swapPending) {
+		front^=1;
+		swapPending=0;
+	}
+	s=&frame[front][digit];
+
+	PORTB=0;
+	PORTD=s->portd;
+	// A Compare Match B of the last slot that was held up past its end
+	// would blank this digit as soon as it is lit
+	TIFR0=_BV(OCF0B);
+	OCR0B=s->ocr;
+	// If another interrupt delayed this one until TCNT0 is at OCR0B
+	// there is no Compare Match B this slot, so leave the digit dark
+	// rather than lit for the whole slot
+	if (TCNT0<s->ocr) PORTB=s->portb;
+
+	digit++;
+	if (digit>=DIGITS) digit=0;
+
+	cycles+=SLOT_CYCLES;
+	while (cycles>=F_CPU/1000) {
+		cycles-=F_CPU/1000;
+		sysMillis++;
+		if ((sysMillis%BUTTON_TICK)==0) SampleButton();
+	}
+
+	loadSlots++;
+	if (!schedIdle) loadBusy++;
+
+	// The timer started counting at the compare match
+	t=TCNT0;
+	loadIsrTicks+=t;
+	if (t>displayIsrMax) displayIsrMax=t;
+}
+
+
+
+//
+// End of the lit part of the slot
+//
+ISR(TIMER0_COMPB_vect) {
+	PORTB=0;
+}
+
+
+
+//
+//
+//
+void InitDisplay(void) {
+	SetBrightness(BRIGHT_MAX);
+
+	// CTC mode, OCR0A sets the slot length
+	OCR0A = SLOT_TICKS-1;
+	TCCR0A = _BV(WGM01);
+	TCCR0B = DISPLAY_CS;
+	// Enable the Compare Match A and B Interrupts
+	TIMSK0 |= _BV(OCIE0A) | _BV(OCIE0B);
+}
+
+
+
+//
+// Share of the time, in percent, the main loop was busy and the CPU
+// was in the slot interrupt since the last call. The busy figure is
+// sampled at the start of each slot, so it is only accurate over many
+// slots.
+//
+void GetCpuLoad(uint8_t *busy, uint8_t *isr) {
+	uint16_t slots, b;
+	uint32_t ticks;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		slots=loadSlots;
+		b=loadBusy;
+		ticks=loadIsrTicks;
+		loadSlots=0;
+		loadBusy=0;
+		loadIsrTicks=0;
+	}
+	if (!slots) slots=1;
+	*busy=(uint32_t)b*100/slots;
+	*isr=ticks*100/((uint32_t)slots*SLOT_TICKS);
+}
+
+
+
+//
+// Set the display brightness, 0 (off) to BRIGHT_MAX
+//
+void SetBrightness(uint8_t level) {
+	if (level>BRIGHT_MAX) level=BRIGHT_MAX;
+	brightness=level;
+	UpdateDisplay();
+}
+
+
+
+//
+//
+//
+uint8_t GetBrightness(void) {
+	return brightness;
+}
+
+
+
+#ifdef DISPLAY_COMPENSATE
+//
+// Number of lit segments in a pattern
+//
+static uint8_t SegmentCount(uint8_t pattern) {
+	return pgm_read_byte(&nibbleBits[pattern&0x0f])+pgm_read_byte(&nibbleBits[pattern>>4]);
+}
+#endif
+
+
+
+//
+// Build the back frame from seg[] and the overlay and have the
+// interrupt switch to it at the start of the next frame
+//
+void UpdateDisplay(void) {
+	slot_t *s;
+	uint8_t gamma, ocr;
+	uint8_t i;
+#ifdef DISPLAY_COMPENSATE
+	uint8_t pattern, o;
+#endif
+
+	// Once the flag is cleared the interrupt won't swap, so the back
+	// buffer stays ours until the flag is set again
+	swapPending=0;
+	s=frame[front^1];
+
+	gamma=pgm_read_byte(&gammaTable[brightness]);
+	ocr=((uint16_t)gamma*SLOT_TICKS)>>8;
+	if (gamma && ocr<MIN_ONTIME) ocr=MIN_ONTIME;
+	if (ocr>MAX_ONTIME) ocr=MAX_ONTIME;
+
+	for (i=0; i<DIGITS; i++, s++) {
+		s->portd=pgm_read_byte(&digitmask[i]) | PORTD_PULLUPS;
+#ifdef DISPLAY_COMPENSATE
+		pattern=(seg[i] & ~overlayMask[i]) ^ overlay[i];
+		o=((uint16_t)ocr*pgm_read_byte(&segmentOnTime[SegmentCount(pattern)]))>>8;
+		if (gamma && o<MIN_ONTIME) o=MIN_ONTIME;
+		s->ocr=o;
+		s->portb=ocr ? pattern : 0;
+#else
+		s->ocr=ocr;
+		s->portb=ocr ? (seg[i] & ~overlayMask[i]) ^ overlay[i] : 0;
+#endif
+	}
+
+	swapPending=1;
+}
+
+
+
+//
+// Render the first six characters of msg as segment patterns, padding
+// with blanks if it is shorter
+//
+void RenderText_P(uint8_t *dst, PGM_P msg) {
+	uint8_t i;
+	char c=1;
+
+	for (i=0; i<DIGITS; i++) {
+		if (c) c=pgm_read_byte(&msg[i]);
+		dst[i]=c ? CHARMAP(c-32) : 0;
+	}
+}
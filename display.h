@@ -0,0 +1,70 @@
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+#define DIGITS		6
+
+// Highest brightness level accepted by SetBrightness()
+#define BRIGHT_MAX	63
+
+// Map the 0..20 dim setting stored in EEPROM onto the brightness scale
+#define DIM_TO_LEVEL(d)	(BRIGHT_MAX-3*(d))
+
+// Refresh rate of the whole display. Each digit is lit once per frame.
+#ifndef DISPLAY_FPS
+#define DISPLAY_FPS	200
+#endif
+
+// Timer0 runs in CTC mode with one compare match A per digit slot. The
+// prescaler is 8 when the slot fits in 256 ticks at that rate, else 64.
+#define SLOT_RATE	(DISPLAY_FPS*DIGITS)
+#if F_CPU/8/SLOT_RATE <= 256
+#define DISPLAY_PRESCALE	8
+#else
+#define DISPLAY_PRESCALE	64
+#endif
+#define SLOT_TICKS	(F_CPU/DISPLAY_PRESCALE/SLOT_RATE)
+#if SLOT_TICKS > 256
+#error "DISPLAY_FPS is too low for Timer0"
+#endif
+
+// At the default 200 FPS this gives prescaler 64 and 104 ticks of 8us
+// per slot. The 64 brightness levels then give 50 distinct on-times
+// instead of 51 with 256 ticks, and displayLatencyMax/displayIsrMax only
+// resolve 64 cycles. Build with DISPLAY_FPS=650 to get prescaler 8 back.
+
+// CPU cycles per digit slot
+#define SLOT_CYCLES	(DISPLAY_PRESCALE*SLOT_TICKS)
+
+// Longest time from the start of a slot to the start and to the end of
+// the multiplex interrupt, in Timer0 ticks. The start includes the
+// fixed prologue, anything above that is time spent waiting for another
+// interrupt to finish.
+extern volatile uint8_t displayLatencyMax;
+extern volatile uint8_t displayIsrMax;
+
+// Segment patterns to show, made visible by UpdateDisplay()
+extern uint8_t seg[DIGITS];
+
+// Animation layer. Segments set in overlayMask are taken from overlay,
+// the others are seg[] inverted where overlay is set, so the output is
+// (seg & ~overlayMask) ^ overlay with overlay kept inside overlayMask
+// where it replaces the picture.
+extern uint8_t overlay[DIGITS];
+extern uint8_t overlayMask[DIGITS];
+
+// Segment bitmaps for ASCII 32..95, kept in flash
+#define DOT		0x80
+#define CHARMAP(i)	pgm_read_byte(&charmap[i])
+extern const uint8_t charmap[] PROGMEM;
+
+void InitDisplay(void);
+void GetCpuLoad(uint8_t *busy, uint8_t *isr);
+void SetBrightness(uint8_t level);
+uint8_t GetBrightness(void);
+void UpdateDisplay(void);
+void RenderText_P(uint8_t *dst, PGM_P msg);
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef HAL_H
+#define HAL_H
+
+// Hardware abstraction for the host build (make host). The firmware
+// talks to the AVR registers directly; on the host those come from the
+// headers in host/ and are backed by the simulator in host/sim.c. The
+// only thing the code itself has to do is give the simulator a chance
+// to run in loops that wait on a register without sleeping.
+
+#ifdef HOST
+void SimIdle(void);
+#define HAL_IDLE()	SimIdle()
+#else
+#define HAL_IDLE()
+#endif
+
+#endif
@@ -0,0 +1,18 @@
+//
+//	host/avr/eeprom.h - EEPROM access for the host build, see sim.c
+//
+
+#ifndef HOST_AVR_EEPROM_H
+#define HOST_AVR_EEPROM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define EEMEM
+
+uint8_t eeprom_read_byte(const uint8_t *p);
+void eeprom_write_byte(uint8_t *p, uint8_t value);
+void eeprom_update_byte(uint8_t *p, uint8_t value);
+void eeprom_read_block(void *dst, const void *src, size_t n);
+
+#endif
@@ -0,0 +1,19 @@
+//
+//	host/avr/interrupt.h - Interrupt handlers for the host build
+//
+//    A handler is an ordinary function named after its vector, which
+//    the simulator calls when the interrupt is due and enabled.
+//
+
+#ifndef HOST_AVR_INTERRUPT_H
+#define HOST_AVR_INTERRUPT_H
+
+#include <avr/io.h>
+
+#define ISR(vector)	void vector(void); void vector(void)
+#define SIGNAL(vector)	ISR(vector)
+
+#define sei()	(SREG|=0x80)
+#define cli()	(SREG&=~0x80)
+
+#endif
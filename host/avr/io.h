@@ -0,0 +1,109 @@
+//
+//	host/avr/io.h - ATmega48 registers for the host build
+//
+//    The registers are plain variables defined in sim.c. The simulator
+//    looks at them whenever simulated time advances and acts on what
+//    the firmware has written, see sim.c.
+//
+
+#ifndef HOST_AVR_IO_H
+#define HOST_AVR_IO_H
+
+#include <stdint.h>
+
+#define _BV(b)			(1<<(b))
+#define bit_is_set(r, b)	((r) & _BV(b))
+#define bit_is_clear(r, b)	(!((r) & _BV(b)))
+
+extern volatile uint8_t PINB, DDRB, PORTB;
+extern volatile uint8_t PINC, DDRC, PORTC;
+extern volatile uint8_t PIND, DDRD, PORTD;
+extern volatile uint8_t TCCR0A, TCCR0B, TCNT0, OCR0A, OCR0B, TIMSK0, TIFR0;
+extern volatile uint8_t ADMUX, ADCSRA, ADCSRB, DIDR0;
+extern volatile uint16_t ADC;
+extern volatile uint8_t TWBR, TWSR, TWAR, TWDR, TWCR;
+extern volatile uint8_t EECR, EEDR;
+extern volatile uint16_t EEAR;
+extern volatile uint8_t UCSR0A, UCSR0B, UCSR0C, UDR0;
+extern volatile uint16_t UBRR0;
+extern volatile uint8_t PCICR, PCMSK1, PCIFR;
+extern volatile uint8_t SMCR, PRR, ACSR, SREG;
+
+// TIMSK0, TIFR0, TCCR0A/B
+#define TOIE0	0
+#define OCIE0A	1
+#define OCIE0B	2
+#define OCF0A	1
+#define OCF0B	2
+#define WGM00	0
+#define WGM01	1
+#define CS00	0
+#define CS01	1
+#define CS02	2
+
+// ADMUX, ADCSRA
+#define MUX0	0
+#define ADLAR	5
+#define REFS0	6
+#define REFS1	7
+#define ADPS0	0
+#define ADPS1	1
+#define ADPS2	2
+#define ADIE	3
+#define ADIF	4
+#define ADATE	5
+#define ADSC	6
+#define ADEN	7
+#define ADC3D	3
+
+// TWCR
+#define TWIE	0
+#define TWEN	2
+#define TWWC	3
+#define TWSTO	4
+#define TWSTA	5
+#define TWEA	6
+#define TWINT	7
+#define TWPS0	0
+#define TWPS1	1
+
+// EECR
+#define EERE	0
+#define EEPE	1
+#define EEMPE	2
+#define EERIE	3
+
+// UCSR0A/B/C
+#define U2X0	1
+#define UDRE0	5
+#define TXC0	6
+#define RXC0	7
+#define TXEN0	3
+#define RXEN0	4
+#define UDRIE0	5
+#define TXCIE0	6
+#define RXCIE0	7
+#define UCSZ00	1
+#define UCSZ01	2
+
+// PCICR, PCMSK1
+#define PCIE1	1
+#define PCINT8	0
+#define PCINT10	2
+
+// SMCR, PRR, ACSR
+#define SE	0
+#define SM0	1
+#define SM1	2
+#define PRADC	0
+#define PRUSART0	1
+#define PRSPI	2
+#define PRTIM1	3
+#define PRTIM0	5
+#define PRTIM2	6
+#define PRTWI	7
+#define ACD	7
+
+#define E2END	255
+
+#endif
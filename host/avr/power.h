@@ -0,0 +1,25 @@
+//
+//	host/avr/power.h - Power reduction bits for the host build
+//
+
+#ifndef HOST_AVR_POWER_H
+#define HOST_AVR_POWER_H
+
+#include <avr/io.h>
+
+#define power_adc_enable()	(PRR&=~_BV(PRADC))
+#define power_adc_disable()	(PRR|=_BV(PRADC))
+#define power_usart0_enable()	(PRR&=~_BV(PRUSART0))
+#define power_usart0_disable()	(PRR|=_BV(PRUSART0))
+#define power_spi_enable()	(PRR&=~_BV(PRSPI))
+#define power_spi_disable()	(PRR|=_BV(PRSPI))
+#define power_timer0_enable()	(PRR&=~_BV(PRTIM0))
+#define power_timer0_disable()	(PRR|=_BV(PRTIM0))
+#define power_timer1_enable()	(PRR&=~_BV(PRTIM1))
+#define power_timer1_disable()	(PRR|=_BV(PRTIM1))
+#define power_timer2_enable()	(PRR&=~_BV(PRTIM2))
+#define power_timer2_disable()	(PRR|=_BV(PRTIM2))
+#define power_twi_enable()	(PRR&=~_BV(PRTWI))
+#define power_twi_disable()	(PRR|=_BV(PRTWI))
+
+#endif
@@ -0,0 +1,17 @@
+//
+//	host/avr/sleep.h - Sleeping runs the simulator until an interrupt
+//
+
+#ifndef HOST_AVR_SLEEP_H
+#define HOST_AVR_SLEEP_H
+
+#include <avr/io.h>
+
+#define SLEEP_MODE_IDLE		0
+#define SLEEP_MODE_ADC		_BV(SM0)
+
+#define set_sleep_mode(mode)	(SMCR=(SMCR & ~(_BV(SM0)|_BV(SM1))) | (mode))
+
+void sleep_mode(void);
+
+#endif
@@ -0,0 +1,50 @@
+#!/bin/sh
+#
+#	host/check.sh - Scripted runs of the host build
+#
+#    Each run gives the simulator a start time, LDR reading, button
+#    presses or console lines, and looks for the expected display (stderr)
+#    or console (stdout) output. Run from default/ with "make host-check".
+#
+
+sim=${1:-./3iClock-host}
+tmp=${TMPDIR:-/tmp}/3iclock-check.$$
+failed=0
+
+trap 'rm -f $tmp.*' 0
+
+# run seconds input [VAR=value ...]
+run() {
+	secs=$1
+	input=$2
+	shift 2
+	printf "$input" | env SIM_SECONDS=$secs "$@" "$sim" >$tmp.out 2>$tmp.disp
+}
+
+# check name pattern file
+check() {
+	if grep -q -e "$2" "$3"; then
+		echo "ok   $1"
+	else
+		echo "FAIL $1"
+		failed=1
+	fi
+}
+
+run 12 "" SIM_TIME=235958 SIM_LDR=1000
+check "time rolls over midnight" "00\.00\.1[01] *on 103/104" $tmp.disp
+
+run 20 "C0003\r\n" SIM_TIME=120000 SIM_LDR=0
+check "lowest levels stay lit" "12\.00\.1[0-9] *on   3/104" $tmp.disp
+
+run 12 "T123456\r\n" SIM_TIME=000000 SIM_LDR=1000
+check "console sets the time" "12\.35\.0[5-7]" $tmp.disp
+
+run 12 "" SIM_TIME=120000 SIM_PRESS=10
+check "button opens the menu" "5ET H" $tmp.disp
+
+run 2 "C0210\r\n" SIM_EEPROM=$tmp.ee
+run 1 "C\r\n" SIM_EEPROM=$tmp.ee
+check "settings survive a restart" "^C ....10" $tmp.out
+
+exit $failed
@@ -0,0 +1,792 @@
+//
+//	host/sim.c - ATmega48 and board simulator for the host build
+//
+//    The firmware is compiled with the system gcc against the headers in
+//    host/, where every register is a plain variable. Simulated time only
+//    moves when the firmware waits: in sleep_mode(), _delay_loop_1() and
+//    HAL_IDLE(). Each time it does, the simulator first acts on what has
+//    been written to the registers (a TWI start, an EEPROM write, an ADC
+//    conversion), then runs time forward event by event and calls the
+//    interrupt handlers that are due, in AVR vector order.
+//
+//    Simulated hardware:
+//      Timer0    CTC/normal mode, compare A and B interrupts, TCNT0
+//      ADC       single and auto-triggered conversions of the LDR
+//      TWI       master transfers to an MCP79410 RTC at 0x6F, which
+//                keeps time and drives its MFP pin (PC2) at 1Hz
+//      EEPROM    256 bytes, 3.4ms per write, EE_READY interrupt
+//      USART0    TX to stdout, RX from stdin
+//      PC0       the button, pressed at the times in SIM_PRESS
+//
+//    The display is decoded from PORTB/PORTD in the multiplex interrupt
+//    and printed to stderr whenever it changes, with the on-time of the
+//    first digit as the time from Compare Match A to the segments being
+//    blanked. A digit blanked as soon as it is lit shows as a space.
+//
+//    Environment:
+//      SIM_SECONDS   simulated run time, default 30
+//      SIM_TIME      RTC start time as hhmmss, default the host clock
+//      SIM_LDR       fixed LDR reading 0..1023, default a slow ramp
+//      SIM_PRESS     button presses, comma separated seconds, a ":ms"
+//                    suffix sets how long it is held (default 150ms)
+//      SIM_EEPROM    file the EEPROM is loaded from and saved to
+//      SIM_RTC_PPM   how much faster the RTC runs than the CPU clock, ppm
+//      SIM_REALTIME  set to run no faster than the wall clock, for typing
+//                    at the console
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include <avr/sleep.h>
+#include <util/delay_basic.h>
+#include <compat/twi.h>
+
+#include "hal.h"
+#include "display.h"
+
+#define NEVER		UINT64_MAX
+#define MS(n)		((uint64_t)(n)*(F_CPU/1000))
+
+#define RTC_ADDRESS	0x6F
+#define RTC_REGS	0x60
+#define LDR_ADC		3
+#define EEPROM_SIZE	(E2END+1)
+#define EEPROM_WRITE	(F_CPU/1000*34/10)
+#define MAX_PRESSES	32
+
+volatile uint8_t PINB, DDRB, PORTB;
+volatile uint8_t PINC, DDRC, PORTC;
+volatile uint8_t PIND, DDRD, PORTD;
+volatile uint8_t TCCR0A, TCCR0B, TCNT0, OCR0A, OCR0B, TIMSK0, TIFR0;
+volatile uint8_t ADMUX, ADCSRA, ADCSRB, DIDR0;
+volatile uint16_t ADC;
+volatile uint8_t TWBR, TWSR, TWAR, TWDR, TWCR;
+volatile uint8_t EECR, EEDR;
+volatile uint16_t EEAR;
+volatile uint8_t UCSR0A, UCSR0B, UCSR0C, UDR0;
+volatile uint16_t UBRR0;
+volatile uint8_t PCICR, PCMSK1, PCIFR;
+volatile uint8_t SMCR, PRR, ACSR, SREG;
+
+// Handlers are weak so a build without one of them still links
+#define VECTOR(v)	extern void v(void) __attribute__((weak));
+VECTOR(PCINT1_vect)
+VECTOR(TIMER0_COMPA_vect)
+VECTOR(TIMER0_COMPB_vect)
+VECTOR(USART_RX_vect)
+VECTOR(USART_UDRE_vect)
+VECTOR(ADC_vect)
+VECTOR(EE_READY_vect)
+VECTOR(TWI_vect)
+
+// Edge triggered interrupt flags, in vector order
+#define IRQ_PCINT1	0x01
+#define IRQ_COMPA	0x02
+#define IRQ_COMPB	0x04
+#define IRQ_RX		0x08
+#define IRQ_ADC		0x10
+#define IRQ_TWI		0x20
+
+static uint64_t now;			// CPU cycles since reset
+static uint64_t endAt;
+static uint8_t pending;
+
+static uint64_t slotStart;		// Timer0 count of 0
+static uint8_t compBDone;
+
+static uint64_t adcDoneAt=NEVER;
+static uint16_t ldrFixed=0xffff;
+
+static uint8_t ee[EEPROM_SIZE];
+static uint64_t eeReadyAt=NEVER;
+static const char *eeFile;
+
+static uint8_t rtc[RTC_REGS];
+static uint8_t rtcPtr;
+static uint64_t rtcHalfAt;		// Next MFP edge
+static uint8_t rtcHalf;			// In the second half of a second
+static uint64_t rtcHalfPeriod=MS(500);
+
+static uint8_t twiMaster;
+static uint8_t twiRead;
+static uint8_t twiFirst;		// Next byte written is the register pointer
+static uint8_t twiAcked;		// Slave answered its address
+static uint8_t twiStatus=TW_NO_INFO;
+static uint8_t twiData;
+static uint64_t twiDoneAt=NEVER;
+static uint32_t twiStarts;
+
+static uint64_t udrEmptyAt;
+static uint64_t rxPollAt;
+static uint8_t rxOpen=1;
+
+static uint64_t pressAt[MAX_PRESSES];
+static uint64_t releaseAt[MAX_PRESSES];
+static uint8_t presses;
+static uint8_t pressIndex;
+
+static uint8_t shown[DIGITS];
+static uint8_t printed[DIGITS];
+static uint8_t onTicks[DIGITS];
+static uint64_t printAt;
+static uint8_t litDigit=DIGITS;		// Digit lit in this slot, DIGITS for none
+static uint8_t litPattern;
+static uint64_t litAt;
+
+static uint32_t isrCount;
+static clock_t hostStart;
+static uint8_t realtime;
+static struct timeval wallStart;
+
+
+
+//
+// Timer0 prescaler from the clock select bits, 0 when stopped
+//
+static uint16_t Prescale(void) {
+	static const uint16_t ps[8]={0, 1, 8, 64, 256, 1024, 0, 0};
+
+	return ps[TCCR0B & 7];
+}
+
+
+
+//
+//
+//
+static uint16_t TimerTop(void) {
+	return (TCCR0A & _BV(WGM01)) ? OCR0A : 255;
+}
+
+
+
+//
+// Simulated LDR reading, a ramp up and down over two minutes unless
+// SIM_LDR is set
+//
+static uint16_t Ldr(void) {
+	uint32_t t;
+
+	if (ldrFixed<=1023) return ldrFixed;
+	t=(now/MS(100))%1200;
+	if (t>=600) t=1200-t;
+	return 30+t*3/2+rand()%5;
+}
+
+
+
+//
+//
+//
+static uint8_t BcdInc(uint8_t v) {
+	v++;
+	if ((v & 0x0f)>9) v+=6;
+	return v;
+}
+
+
+
+//
+//
+//
+static uint8_t DaysInMonth(uint8_t month, uint8_t year) {
+	if (month==0x02) return ((year>>4)*10+(year & 15))%4 ? 0x28 : 0x29;
+	if (month==0x04 || month==0x06 || month==0x09 || month==0x11) return 0x30;
+	return 0x31;
+}
+
+
+
+//
+// Advance the RTC by one second when its oscillator is enabled
+//
+static void RtcTick(void) {
+	uint8_t v;
+
+	if (!(rtc[0] & 0x80)) return;
+	v=BcdInc(rtc[0] & 0x7f);
+	rtc[0]=0x80 | (v<0x60 ? v : 0);
+	if (v<0x60) return;
+	v=BcdInc(rtc[1] & 0x7f);
+	rtc[1]=v<0x60 ? v : 0;
+	if (v<0x60) return;
+	v=BcdInc(rtc[2] & 0x3f);
+	rtc[2]=(rtc[2] & 0xc0) | (v<0x24 ? v : 0);
+	if (v<0x24) return;
+	rtc[3]=(rtc[3] & 0xf8) | ((rtc[3] & 7)%7+1);
+	v=BcdInc(rtc[4]);
+	if (v<=DaysInMonth(rtc[5] & 0x1f, rtc[6])) {
+		rtc[4]=v;
+		return;
+	}
+	rtc[4]=1;
+	v=BcdInc(rtc[5] & 0x1f);
+	rtc[5]=(rtc[5] & 0xe0) | (v<=0x12 ? v : 1);
+	if (v<=0x12) return;
+	rtc[6]=rtc[6]==0x99 ? 0 : BcdInc(rtc[6]);
+}
+
+
+
+//
+// MFP edge every half second. The second starts on the falling edge.
+//
+static void RtcHalfSecond(void) {
+	uint8_t old=PINC;
+
+	rtcHalf^=1;
+	if (!rtcHalf) RtcTick();
+	rtcHalfAt+=rtcHalfPeriod;
+
+	if ((rtc[7] & 0x40) && !rtcHalf) {
+		PINC&=~_BV(2);
+	} else {
+		PINC|=_BV(2);
+	}
+	if ((old^PINC) & PCMSK1 & _BV(PCINT10) && (PCICR & _BV(PCIE1))) {
+		pending|=IRQ_PCINT1;
+	}
+}
+
+
+
+//
+//
+//
+static void RtcWrite(uint8_t reg, uint8_t v) {
+	rtc[reg%RTC_REGS]=v;
+	// Writing the seconds restarts the divider
+	if (reg==0) {
+		rtcHalf=0;
+		rtcHalfAt=now+rtcHalfPeriod;
+	}
+}
+
+
+
+//
+// Act on a TWCR write with TWINT set: start, stop, or move one byte
+//
+static void TwiCommand(void) {
+	uint32_t scl;
+
+	TWCR&=~_BV(TWINT);
+
+	if (TWCR & _BV(TWSTO)) {
+		twiMaster=0;
+		TWCR&=~_BV(TWSTO);
+	}
+
+	if (TWCR & _BV(TWSTA)) {
+		twiStatus=twiMaster ? TW_REP_START : TW_START;
+		if (!twiMaster) twiStarts++;
+		twiMaster=1;
+	} else if (!twiMaster) {
+		return;
+	} else if (twiStatus==TW_START || twiStatus==TW_REP_START) {
+		twiRead=TWDR & 1;
+		twiAcked=(TWDR>>1)==RTC_ADDRESS;
+		twiFirst=1;
+		if (twiRead) {
+			twiStatus=twiAcked ? TW_MR_SLA_ACK : TW_MR_SLA_NACK;
+		} else {
+			twiStatus=twiAcked ? TW_MT_SLA_ACK : TW_MT_SLA_NACK;
+		}
+	} else if (!twiRead) {
+		if (twiFirst) {
+			rtcPtr=TWDR%RTC_REGS;
+			twiFirst=0;
+		} else {
+			RtcWrite(rtcPtr, TWDR);
+			rtcPtr=(rtcPtr+1)%RTC_REGS;
+		}
+		twiStatus=TW_MT_DATA_ACK;
+	} else {
+		twiData=rtc[rtcPtr];
+		rtcPtr=(rtcPtr+1)%RTC_REGS;
+		twiStatus=(TWCR & _BV(TWEA)) ? TW_MR_DATA_ACK : TW_MR_DATA_NACK;
+	}
+
+	// Nine SCL periods per byte
+	scl=16+2*TWBR*(1<<(2*(TWSR & 3)));
+	twiDoneAt=now+9*scl;
+}
+
+
+
+//
+//
+//
+static void StartConversion(void) {
+	if (!(ADCSRA & _BV(ADEN)) || adcDoneAt!=NEVER) return;
+	ADCSRA|=_BV(ADSC);
+	adcDoneAt=now+13*(2<<((ADCSRA & 7) ? (ADCSRA & 7)-1 : 0));
+}
+
+
+
+//
+// Look at what the firmware has written to the registers
+//
+static void Poll(void) {
+	if ((TWCR & _BV(TWEN)) && (TWCR & _BV(TWINT)) && twiDoneAt==NEVER) {
+		TwiCommand();
+	}
+
+	if ((ADCSRA & _BV(ADSC)) && adcDoneAt==NEVER) {
+		StartConversion();
+	}
+
+	if ((EECR & _BV(EEPE)) && eeReadyAt==NEVER) {
+		ee[EEAR%EEPROM_SIZE]=EEDR;
+		eeReadyAt=now+EEPROM_WRITE;
+	}
+}
+
+
+
+//
+// Print the display when it has changed, at most every 50ms
+//
+static void PrintDisplay(void) {
+	char text[2*DIGITS+1];
+	uint8_t i, j, n=0;
+	uint8_t p;
+
+	if (!memcmp(shown, printed, DIGITS) || now<printAt) return;
+	memcpy(printed, shown, DIGITS);
+	printAt=now+MS(50);
+
+	for (i=0; i<DIGITS; i++) {
+		p=shown[i] & ~DOT;
+		for (j=0; j<64 && pgm_read_byte(&charmap[j])!=p; j++);
+		text[n++]=p==0 ? ' ' : j<64 ? j+32 : '?';
+		if (shown[i] & DOT) text[n++]='.';
+	}
+	text[n]=0;
+	fprintf(stderr, "[%9.3f] %-12s on %3u/%u\n", now/(double)F_CPU, text, onTicks[0], TimerTop()+1);
+}
+
+
+
+//
+// The lit digit has been blanked, or its slot is over
+//
+static void EndDigit(void) {
+	uint8_t i=litDigit;
+
+	if (i>=DIGITS) return;
+	litDigit=DIGITS;
+	onTicks[i]=Prescale() ? (now-litAt)/Prescale() : 0;
+	shown[i]=onTicks[i] ? litPattern : 0;
+	if (i==DIGITS-1) PrintDisplay();
+}
+
+
+
+//
+// The multiplex interrupt has set up a digit, note what it shows
+//
+static void StartDigit(void) {
+	uint8_t i;
+
+	for (i=0; i<DIGITS && !(PORTD & (0x80>>i)); i++);
+	litDigit=i;
+	litPattern=PORTB;
+	litAt=now;
+}
+
+
+
+//
+// Call a handler as the hardware would, with interrupts disabled
+//
+static void Call(void (*handler)(void)) {
+	uint8_t sreg=SREG;
+
+	if (!handler) return;
+	SREG&=~0x80;
+	isrCount++;
+	handler();
+	SREG=sreg | 0x80;
+}
+
+
+
+//
+// Run the interrupts that are due and enabled, highest priority
+// first. Returns how many ran.
+//
+static uint8_t Dispatch(void) {
+	uint8_t ran=0;
+	uint8_t wasEnabled;
+
+	while ((SREG & 0x80) && ran<32) {
+		Poll();
+		TCNT0=Prescale() ? (now-slotStart)/Prescale() : 0;
+
+		if ((pending & IRQ_PCINT1) && (PCICR & _BV(PCIE1))) {
+			pending&=~IRQ_PCINT1;
+			Call(PCINT1_vect);
+		} else if ((pending & IRQ_COMPA) && (TIMSK0 & _BV(OCIE0A))) {
+			pending&=~IRQ_COMPA;
+			EndDigit();
+			Call(TIMER0_COMPA_vect);
+			// Writing a one clears the flag
+			if (TIFR0 & _BV(OCF0B)) pending&=~IRQ_COMPB;
+			TIFR0=0;
+			StartDigit();
+		} else if ((pending & IRQ_COMPB) && (TIMSK0 & _BV(OCIE0B))) {
+			pending&=~IRQ_COMPB;
+			Call(TIMER0_COMPB_vect);
+			if (!PORTB) EndDigit();
+		} else if ((pending & IRQ_RX) && (UCSR0B & _BV(RXCIE0))) {
+			pending&=~IRQ_RX;
+			Call(USART_RX_vect);
+		} else if ((UCSR0B & _BV(UDRIE0)) && now>=udrEmptyAt) {
+			// The driver either sends a byte or turns the interrupt off
+			Call(USART_UDRE_vect);
+			wasEnabled=UCSR0B & _BV(UDRIE0);
+			if (wasEnabled) {
+				putchar(UDR0);
+				fflush(stdout);
+				udrEmptyAt=now+(UCSR0A & _BV(U2X0) ? 8 : 16)*(UBRR0+1)*10;
+			}
+		} else if ((pending & IRQ_ADC) && (ADCSRA & _BV(ADIE))) {
+			pending&=~IRQ_ADC;
+			ADCSRA&=~_BV(ADIF);
+			Call(ADC_vect);
+		} else if ((EECR & _BV(EERIE)) && !(EECR & _BV(EEPE))) {
+			Call(EE_READY_vect);
+		} else if ((pending & IRQ_TWI) && (TWCR & _BV(TWIE))) {
+			pending&=~IRQ_TWI;
+			Call(TWI_vect);
+		} else {
+			break;
+		}
+		ran++;
+	}
+	Poll();
+	return ran;
+}
+
+
+
+//
+// Time of the next thing that happens on its own
+//
+static uint64_t NextEvent(void) {
+	uint64_t t=endAt;
+	uint64_t e;
+	uint16_t ps=Prescale();
+
+	if (ps) {
+		e=slotStart+(uint64_t)(TimerTop()+1)*ps;
+		if (e<t) t=e;
+		e=slotStart+(uint64_t)(OCR0B+1)*ps;
+		if (!compBDone && OCR0B<=TimerTop() && e<t) t=e;
+	}
+	if (adcDoneAt<t) t=adcDoneAt;
+	if (eeReadyAt<t) t=eeReadyAt;
+	if (twiDoneAt<t) t=twiDoneAt;
+	if (rtcHalfAt<t) t=rtcHalfAt;
+	if (pressIndex<presses) {
+		e=(PINC & _BV(0)) ? pressAt[pressIndex] : releaseAt[pressIndex];
+		if (e<t) t=e;
+	}
+	if ((UCSR0B & _BV(UDRIE0)) && udrEmptyAt>now && udrEmptyAt<t) t=udrEmptyAt;
+	if (rxOpen && (UCSR0B & _BV(RXEN0)) && rxPollAt<t) t=rxPollAt;
+	if (t<now) t=now;
+	return t;
+}
+
+
+
+//
+//
+//
+static void Finish(void) {
+	double host=(double)(clock()-hostStart)/CLOCKS_PER_SEC;
+	FILE *f;
+
+	fprintf(stderr, "%.1fs simulated in %.2fs, %u interrupts, %u TWI transfers\n",
+		now/(double)F_CPU, host, isrCount, twiStarts);
+	if (eeFile && (f=fopen(eeFile, "wb"))) {
+		fwrite(ee, 1, EEPROM_SIZE, f);
+		fclose(f);
+	}
+	exit(0);
+}
+
+
+
+//
+// Hold simulated time back to the wall clock
+//
+static void Pace(void) {
+	struct timeval tv;
+	int64_t ahead;
+
+	gettimeofday(&tv, 0);
+	ahead=(int64_t)(now/(F_CPU/1000000))
+		-((int64_t)(tv.tv_sec-wallStart.tv_sec)*1000000+tv.tv_usec-wallStart.tv_usec);
+	if (ahead>0) usleep(ahead);
+}
+
+
+
+//
+// Handle everything due at the current time
+//
+static void Events(void) {
+	uint16_t ps=Prescale();
+	uint8_t old;
+	int c;
+
+	if (now>=endAt) Finish();
+
+	if (ps) {
+		// The flags are set on the timer clock after the match, so with
+		// OCR0B equal to OCR0A both come together at the end of the slot
+		if (!compBDone && OCR0B<=TimerTop() && now>=slotStart+(uint64_t)(OCR0B+1)*ps) {
+			compBDone=1;
+			pending|=IRQ_COMPB;
+		}
+		if (now>=slotStart+(uint64_t)(TimerTop()+1)*ps) {
+			slotStart=now;
+			compBDone=0;
+			pending|=IRQ_COMPA;
+			if ((ADCSRA & _BV(ADATE)) && (ADCSRB & 7)==3) StartConversion();
+		}
+	} else {
+		slotStart=now;
+	}
+
+	if (now>=adcDoneAt) {
+		adcDoneAt=NEVER;
+		ADC=(ADMUX & 0x0f)==LDR_ADC ? Ldr() : 0;
+		ADCSRA=(ADCSRA & ~_BV(ADSC)) | _BV(ADIF);
+		pending|=IRQ_ADC;
+	}
+
+	if (now>=eeReadyAt) {
+		eeReadyAt=NEVER;
+		EECR&=~(_BV(EEPE) | _BV(EEMPE));
+	}
+
+	if (now>=twiDoneAt) {
+		twiDoneAt=NEVER;
+		TWSR=twiStatus | (TWSR & 3);
+		if (twiRead && twiStatus>=TW_MR_DATA_ACK) TWDR=twiData;
+		pending|=IRQ_TWI;
+	}
+
+	if (now>=rtcHalfAt) RtcHalfSecond();
+
+	if (pressIndex<presses) {
+		old=PINC;
+		if (now>=pressAt[pressIndex]) PINC&=~_BV(0);
+		if (now>=releaseAt[pressIndex]) {
+			PINC|=_BV(0);
+			pressIndex++;
+		}
+		if ((old^PINC) & PCMSK1 & _BV(PCINT8) && (PCICR & _BV(PCIE1))) {
+			pending|=IRQ_PCINT1;
+		}
+	}
+
+	if (rxOpen && (UCSR0B & _BV(RXEN0)) && now>=rxPollAt) {
+		rxPollAt=now+MS(1);
+		if (realtime) Pace();
+		c=getchar();
+		if (c!=EOF) {
+			UDR0=c;
+			pending|=IRQ_RX;
+		} else if (feof(stdin)) {
+			rxOpen=0;
+		} else {
+			clearerr(stdin);
+		}
+	}
+}
+
+
+
+//
+// Run until the given time, or with wake set until an interrupt has run
+//
+static void Run(uint64_t until, uint8_t wake) {
+	uint64_t t;
+
+	for (;;) {
+		if (Dispatch() && wake) return;
+		t=NextEvent();
+		if (!wake && t>until) {
+			now=until;
+			return;
+		}
+		now=t;
+		Events();
+	}
+}
+
+
+
+//
+// Sleeping waits for the next interrupt. In ADC Noise Reduction mode
+// that starts a conversion, as on the chip.
+//
+void sleep_mode(void) {
+	if ((SMCR & (_BV(SM0) | _BV(SM1)))==SLEEP_MODE_ADC) StartConversion();
+	Run(0, 1);
+}
+
+
+
+//
+//
+//
+void _delay_loop_1(uint8_t count) {
+	Run(now+3*(count ? count : 256), 0);
+}
+
+
+
+//
+//
+//
+void SimIdle(void) {
+	Run(now+16, 0);
+}
+
+
+
+//
+//
+//
+uint8_t eeprom_read_byte(const uint8_t *p) {
+	return ee[(uintptr_t)p%EEPROM_SIZE];
+}
+
+
+
+//
+//
+//
+void eeprom_write_byte(uint8_t *p, uint8_t value) {
+	ee[(uintptr_t)p%EEPROM_SIZE]=value;
+	Run(now+EEPROM_WRITE, 0);
+}
+
+
+
+//
+//
+//
+void eeprom_update_byte(uint8_t *p, uint8_t value) {
+	if (eeprom_read_byte(p)!=value) eeprom_write_byte(p, value);
+}
+
+
+
+//
+//
+//
+void eeprom_read_block(void *dst, const void *src, size_t n) {
+	uint8_t *d=dst;
+	uintptr_t a=(uintptr_t)src;
+
+	while (n--) {
+		*d++=ee[a++%EEPROM_SIZE];
+	}
+}
+
+
+
+//
+// Parse "t[:ms],t[:ms],.." into press and release times
+//
+static void ParsePresses(const char *s) {
+	double t;
+	unsigned ms;
+	int n;
+
+	while (s && presses<MAX_PRESSES && sscanf(s, "%lf%n", &t, &n)==1) {
+		s+=n;
+		ms=150;
+		if (*s==':' && sscanf(s+1, "%u%n", &ms, &n)==1) s+=n+1;
+		pressAt[presses]=(uint64_t)(t*F_CPU);
+		releaseAt[presses]=pressAt[presses]+MS(ms);
+		presses++;
+		s=strchr(s, ',');
+		if (s) s++;
+	}
+}
+
+
+
+//
+// Power-on state of the chip and the board
+//
+__attribute__((constructor))
+static void SimInit(void) {
+	const char *s;
+	time_t t;
+	struct tm *tm;
+	unsigned h, m, sec;
+	FILE *f;
+
+	hostStart=clock();
+	PINC=_BV(0) | _BV(2) | _BV(4) | _BV(5);
+	UCSR0A=_BV(UDRE0);
+	TWSR=0xf8;
+
+	s=getenv("SIM_SECONDS");
+	endAt=(uint64_t)((s ? atof(s) : 30)*F_CPU);
+	s=getenv("SIM_LDR");
+	if (s) ldrFixed=atoi(s);
+	ParsePresses(getenv("SIM_PRESS"));
+	s=getenv("SIM_RTC_PPM");
+	if (s) rtcHalfPeriod=MS(500)*1e6/(1e6+atof(s));
+	realtime=getenv("SIM_REALTIME")!=0;
+	gettimeofday(&wallStart, 0);
+
+	memset(ee, 0xff, sizeof(ee));
+	eeFile=getenv("SIM_EEPROM");
+	if (eeFile && (f=fopen(eeFile, "rb"))) {
+		if (fread(ee, 1, EEPROM_SIZE, f)) {}
+		fclose(f);
+	}
+
+	t=time(0);
+	tm=localtime(&t);
+	h=tm->tm_hour;
+	m=tm->tm_min;
+	sec=tm->tm_sec;
+	s=getenv("SIM_TIME");
+	if (s && strlen(s)==6) {
+		h=(s[0]-'0')*10+s[1]-'0';
+		m=(s[2]-'0')*10+s[3]-'0';
+		sec=(s[4]-'0')*10+s[5]-'0';
+	}
+	rtc[0]=0x80 | (sec/10)<<4 | sec%10;
+	rtc[1]=(m/10)<<4 | m%10;
+	rtc[2]=(h/10)<<4 | h%10;
+	rtc[3]=0x28 | (tm->tm_wday+1);
+	rtc[4]=(tm->tm_mday/10)<<4 | tm->tm_mday%10;
+	rtc[5]=((tm->tm_mon+1)/10)<<4 | (tm->tm_mon+1)%10;
+	rtc[6]=((tm->tm_year%100)/10)<<4 | tm->tm_year%10;
+	rtcHalf=1;
+	rtcHalfAt=rtcHalfPeriod;
+
+	fcntl(0, F_SETFL, fcntl(0, F_GETFL) | O_NONBLOCK);
+}
@@ -0,0 +1,22 @@
+//
+//	host/util/atomic.h - ATOMIC_BLOCK on the simulated SREG
+//
+
+#ifndef HOST_UTIL_ATOMIC_H
+#define HOST_UTIL_ATOMIC_H
+
+#include <avr/interrupt.h>
+
+static inline uint8_t __iCliRetVal(void) {
+	cli();
+	return 1;
+}
+
+static inline void __iRestore(const uint8_t *s) {
+	SREG=*s;
+}
+
+#define ATOMIC_RESTORESTATE	uint8_t sreg_save __attribute__((__cleanup__(__iRestore)))=SREG
+#define ATOMIC_BLOCK(type)	for (type, __ToDo=__iCliRetVal(); __ToDo; __ToDo=0)
+
+#endif
@@ -0,0 +1,20 @@
+//
+//	host/util/crc16.h - Dallas/iButton CRC8 as in avr-libc
+//
+
+#ifndef HOST_UTIL_CRC16_H
+#define HOST_UTIL_CRC16_H
+
+#include <stdint.h>
+
+static inline uint8_t _crc_ibutton_update(uint8_t crc, uint8_t data) {
+	uint8_t i;
+
+	crc^=data;
+	for (i=0; i<8; i++) {
+		crc=(crc & 1) ? (crc>>1)^0x8C : crc>>1;
+	}
+	return crc;
+}
+
+#endif
@@ -0,0 +1,13 @@
+//
+//	host/util/delay_basic.h - Busy waits advance the simulated time
+//
+
+#ifndef HOST_UTIL_DELAY_BASIC_H
+#define HOST_UTIL_DELAY_BASIC_H
+
+#include <stdint.h>
+
+// 3 cycles per count, 0 counts as 256
+void _delay_loop_1(uint8_t count);
+
+#endif
@@ -0,0 +1,125 @@
+//
+//	rtc.c - Driver for the MCP79410 RTC on the TWI-bus
+//
+//    The timekeeping registers are fetched with a single auto-incrementing
+//    read into rtcImage[] so that all fields come from the same instant,
+//    and the time is written back in one transaction so that hour, minute
+//    and second are always updated together.
+//
+//    StartRTCRefresh() queues that read on the TWI-bus and returns at
+//    once. FinishRTCRefresh() picks up the result, sleeping first if the
+//    transfer is still in progress.
+//
+
+#include <avr/io.h>
+
+#include "twi.h"
+#include "rtc.h"
+
+uint8_t rtcImage[RTC_TIMEREGS];
+
+// Background read of the timekeeping registers
+static uint8_t rtcBuffer[RTC_TIMEREGS];
+static twi_txn rtcTxn;
+
+
+
+//
+// Read a single register from the RTC. Returns the TWI status, 0 if ok.
+//
+uint8_t ReadRTC(const uint8_t adr, uint8_t *data) {
+	return ReadRTCBlock(adr, data, 1);
+}
+
+
+
+//
+// Write a single register in the RTC. Returns the TWI status, 0 if ok.
+//
+uint8_t WriteRTCByte(const uint8_t adr, const uint8_t data) {
+	return WriteRTCBlock(adr, &data, 1);
+}
+
+
+
+//
+// Read len consecutive registers starting at adr. The RTC auto-increments
+// its address pointer so the whole block is clocked out in one
+// transaction, directly into data.
+// Returns the TWI status, 0 if ok.
+//
+uint8_t ReadRTCBlock(const uint8_t adr, uint8_t *data, const uint8_t len) {
+	return twi_readRegs(RTCADDR, adr, data, len);
+}
+
+
+
+//
+// Write len consecutive registers starting at adr in one transaction.
+// Returns the TWI status, 0 if ok.
+//
+uint8_t WriteRTCBlock(const uint8_t adr, const uint8_t *data, const uint8_t len) {
+	return twi_writeRegs(RTCADDR, adr, data, len);
+}
+
+
+
+//
+// Queue a burst read of the timekeeping registers. Nothing is done if
+// the previous read hasn't completed yet.
+//
+void StartRTCRefresh(void) {
+	if (rtcTxn.status==TWI_PENDING) return;
+
+	rtcTxn.address=RTCADDR;
+	rtcTxn.flags=TWI_TXN_REG;
+	rtcTxn.reg=RTC_SECONDS;
+	rtcTxn.txLength=0;
+	rtcTxn.rxData=rtcBuffer;
+	rtcTxn.rxLength=RTC_TIMEREGS;
+	rtcTxn.callback=0;
+	twi_submit(&rtcTxn);
+}
+
+
+
+//
+// Wait for the read queued by StartRTCRefresh() and copy it to
+// rtcImage[]. The image is left untouched if the read failed.
+// Returns the TWI status, 0 if ok.
+//
+uint8_t FinishRTCRefresh(void) {
+	uint8_t i;
+	uint8_t err;
+
+	err=twi_wait(&rtcTxn);
+	if (err) return err;
+	for (i=0; i<RTC_TIMEREGS; i++) rtcImage[i]=rtcBuffer[i];
+	return TWI_OK;
+}
+
+
+
+//
+// Burst read the timekeeping registers into rtcImage[]
+//
+uint8_t RefreshRTCImage(void) {
+	StartRTCRefresh();
+	return FinishRTCRefresh();
+}
+
+
+
+//
+// Set hour, minute and second (BCD) in a single transaction. The
+// oscillator start bit is always set so the clock keeps running.
+// Returns the TWI status, 0 if ok.
+//
+uint8_t WriteRTCTime(const uint8_t hour, const uint8_t minute, const uint8_t second) {
+	uint8_t tmp[3];
+
+	tmp[0]=second | RTC_ST;
+	tmp[1]=minute;
+	tmp[2]=hour;
+	return WriteRTCBlock(RTC_SECONDS, tmp, 3);
+}
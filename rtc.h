@@ -0,0 +1,43 @@
+#ifndef RTC_H
+#define RTC_H
+
+#include <stdint.h>
+
+// Address for the RCT on the TWI-bus
+#define RTCADDR 0x6F
+
+// MCP79410 timekeeping registers
+#define RTC_SECONDS	0x00
+#define RTC_MINUTES	0x01
+#define RTC_HOURS	0x02
+#define RTC_WEEKDAY	0x03
+#define RTC_DATE	0x04
+#define RTC_MONTH	0x05
+#define RTC_YEAR	0x06
+#define RTC_CONTROL	0x07
+
+// Number of timekeeping registers held in the cached image
+#define RTC_TIMEREGS	7
+
+// Oscillator start bit in the seconds register
+#define RTC_ST		0x80
+
+// Control register: square wave output on MFP at 1Hz
+#define RTC_SQWEN	0x40
+#define RTC_SQW_1HZ	0x00
+
+// Copy of registers 0x00..0x06 from the last burst read
+extern uint8_t rtcImage[RTC_TIMEREGS];
+
+// All functions returning uint8_t give the TWI status, TWI_OK (0) on
+// success, see twi.h for the error codes
+uint8_t ReadRTC(const uint8_t adr, uint8_t *data);
+uint8_t WriteRTCByte(const uint8_t adr, const uint8_t data);
+uint8_t ReadRTCBlock(const uint8_t adr, uint8_t *data, const uint8_t len);
+uint8_t WriteRTCBlock(const uint8_t adr, const uint8_t *data, const uint8_t len);
+void StartRTCRefresh(void);
+uint8_t FinishRTCRefresh(void);
+uint8_t RefreshRTCImage(void);
+uint8_t WriteRTCTime(const uint8_t hour, const uint8_t minute, const uint8_t second);
+
+#endif
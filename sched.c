@@ -0,0 +1,155 @@
+//
+//	sched.c - Millisecond tick and cooperative task scheduler
+//
+//    The tick is counted by the display interrupt, so timing follows
+//    F_CPU and doesn't drift when other interrupts fire. Tasks are plain
+//    functions called from RunTasks() when their deadline has passed;
+//    periodic tasks are then given a new deadline one period later and
+//    one-shot tasks (period 0) are removed. When nothing is due the CPU
+//    sleeps until the next interrupt.
+//
+//    An interrupt can make a task run right away with WakeTask(). Its
+//    deadline is then pushed a full period ahead, so the period works as
+//    a timeout for tasks that are normally driven by an event.
+//
+
+#include <avr/io.h>
+#include <avr/sleep.h>
+#include <util/atomic.h>
+
+#include "sched.h"
+
+typedef struct {
+	void (*run)(void);
+	uint16_t period;
+	uint16_t due;
+} task_t;
+
+static task_t tasks[MAX_TASKS];
+
+// One bit per task woken from an interrupt
+static volatile uint8_t taskWake;
+
+volatile uint16_t sysMillis;
+uint16_t schedPasses;
+volatile uint8_t schedIdle;
+
+
+
+//
+// Milliseconds since start, wraps after ~65s
+//
+uint16_t GetMillis(void) {
+	uint16_t v;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		v=sysMillis;
+	}
+	return v;
+}
+
+
+
+//
+// Sleep in idle mode for the given number of milliseconds. Every
+// display interrupt wakes the CPU, so the time is checked often enough.
+//
+void SleepMs(uint16_t ms) {
+	uint16_t start;
+
+	start=GetMillis();
+	while ((uint16_t)(GetMillis()-start) < ms) {
+		schedIdle=1;
+		sleep_mode();
+		schedIdle=0;
+	}
+}
+
+
+
+//
+// Run a task after delay ms, and then every period ms if period is not 0.
+// Returns the task id, or NO_TASK if the table is full.
+//
+uint8_t AddTask(void (*run)(void), uint16_t delay, uint16_t period) {
+	uint8_t i;
+
+	for (i=0; i<MAX_TASKS; i++) {
+		if (!tasks[i].run) {
+			tasks[i].period=period;
+			tasks[i].due=GetMillis()+delay;
+			tasks[i].run=run;
+			return i;
+		}
+	}
+	return NO_TASK;
+}
+
+
+
+//
+//
+//
+void StopTask(uint8_t id) {
+	if (id<MAX_TASKS) tasks[id].run=0;
+}
+
+
+
+//
+// Have a task run on the next pass of RunTasks(), may be called from
+// an interrupt
+//
+void WakeTask(uint8_t id) {
+	if (id<MAX_TASKS) taskWake|=1<<id;
+}
+
+
+
+//
+// Run every task whose deadline has passed or that has been woken, or
+// sleep if there was nothing to do
+//
+void RunTasks(void) {
+	task_t *t;
+	void (*run)(void);
+	uint16_t now;
+	uint8_t woken;
+	uint8_t bit=1;
+	uint8_t ran=0;
+
+	schedPasses++;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		woken=taskWake;
+		taskWake=0;
+	}
+
+	for (t=tasks; t<tasks+MAX_TASKS; t++, bit<<=1) {
+		now=GetMillis();
+		if (!t->run) continue;
+		if (woken & bit) {
+			t->due=now;
+		} else if ((int16_t)(now-t->due)<0) {
+			continue;
+		}
+
+		run=t->run;
+		if (t->period) {
+			t->due+=t->period;
+			// Don't try to catch up after a long stall
+			if ((int16_t)(now-t->due)>=0) t->due=now+t->period;
+		} else {
+			t->run=0;
+		}
+		run();
+		ran=1;
+	}
+
+	// A task woken between the test and the sleep is only delayed until
+	// the next display interrupt
+	if (!ran && !taskWake) {
+		schedIdle=1;
+		sleep_mode();
+		schedIdle=0;
+	}
+}
@@ -0,0 +1,28 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+
+// Size of the task table
+#define MAX_TASKS	8
+
+// Task id returned when the table is full
+#define NO_TASK		0xff
+
+// Milliseconds since start, advanced from the display interrupt
+extern volatile uint16_t sysMillis;
+
+// Passes through RunTasks(), for the statistics
+extern uint16_t schedPasses;
+
+// Set while the main loop sleeps, for the CPU load statistics
+extern volatile uint8_t schedIdle;
+
+uint16_t GetMillis(void);
+void SleepMs(uint16_t ms);
+uint8_t AddTask(void (*run)(void), uint16_t delay, uint16_t period);
+void StopTask(uint8_t id);
+void WakeTask(uint8_t id);
+void RunTasks(void);
+
+#endif
@@ -0,0 +1,223 @@
+//
+//	settings.c - Settings record in EEPROM with wear levelling
+//
+//    SaveSettings() only builds the new record and starts the EEPROM
+//    ready interrupt, which then writes the record a byte at a time.
+//    Bytes that already hold the right value are skipped, which is
+//    common as the slot being overwritten has an older copy of the
+//    same settings. The CRC is the last byte written, so a record cut
+//    short by a reset fails the check and the previous slot is used.
+//
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include <util/atomic.h>
+#include <util/crc16.h>
+
+#include "display.h"
+#include "settings.h"
+
+// Must fit in SETTINGS_SLOT_SIZE
+typedef struct {
+	uint8_t version;
+	uint8_t seq;
+	uint8_t threshold;
+	uint8_t level;
+	uint8_t curve[CURVE_POINTS];
+	uint8_t crc;			// Must be last
+} record_t;
+
+#define RECORD_DATA	(sizeof(record_t)-1)
+
+// Version 1 records end with the CRC after the level
+#define RECORD_DATA_V1	4
+
+// Single bytes used before the record, read when there is no record
+#define LEGACY_THRESHOLD	0
+#define LEGACY_LEVEL		1
+
+uint8_t brightnessThreshold;
+uint8_t dimLevel;
+uint8_t brightnessCurve[CURVE_POINTS];
+
+static record_t record;			// Being written, or last loaded
+static uint8_t slot;			// Slot of record
+static volatile uint8_t writeIndex=sizeof(record_t);
+static volatile uint8_t savePending;
+
+
+
+//
+//
+//
+static uint8_t RecordCrc(const record_t *r, uint8_t len) {
+	const uint8_t *p=(const uint8_t *)r;
+	uint8_t crc=0;
+	uint8_t i;
+
+	for (i=0; i<len; i++) {
+		crc=_crc_ibutton_update(crc, p[i]);
+	}
+	return crc;
+}
+
+
+
+//
+// Check the CRC, which follows the data of the record's version
+//
+static uint8_t RecordValid(const record_t *r) {
+	const uint8_t *p=(const uint8_t *)r;
+
+	if (r->version==SETTINGS_VERSION) return p[RECORD_DATA]==RecordCrc(r, RECORD_DATA);
+	if (r->version==1) return p[RECORD_DATA_V1]==RecordCrc(r, RECORD_DATA_V1);
+	return 0;
+}
+
+
+
+//
+//
+//
+static uint8_t *SlotAddress(uint8_t n) {
+	return (uint8_t *)(uintptr_t)(SETTINGS_BASE+n*SETTINGS_SLOT_SIZE);
+}
+
+
+
+//
+// Put the next record in the next slot and start writing it
+//
+static void StartWrite(void) {
+	uint8_t i;
+
+	record.version=SETTINGS_VERSION;
+	record.seq++;
+	record.threshold=brightnessThreshold;
+	record.level=dimLevel;
+	for (i=0; i<CURVE_POINTS; i++) {
+		record.curve[i]=brightnessCurve[i];
+	}
+	record.crc=RecordCrc(&record, RECORD_DATA);
+	slot=(slot+1)%SETTINGS_SLOTS;
+	savePending=0;
+	writeIndex=0;
+	EECR|=(1<<EERIE);
+}
+
+
+
+//
+// Write the next byte of the record that differs from the EEPROM
+//
+ISR(EE_READY_vect) {
+	uint8_t *adr;
+	uint8_t b;
+
+	while (writeIndex<sizeof(record_t)) {
+		adr=SlotAddress(slot)+writeIndex;
+		b=((uint8_t *)&record)[writeIndex++];
+		if (eeprom_read_byte(adr)!=b) {
+			EEAR=(uintptr_t)adr;
+			EEDR=b;
+			EECR|=(1<<EEMPE);
+			EECR|=(1<<EEPE);
+			return;
+		}
+	}
+
+	if (savePending) {
+		StartWrite();
+	} else {
+		EECR&=~(1<<EERIE);
+	}
+}
+
+
+
+//
+// Load the newest valid record, falling back to the old single byte
+// settings and then the defaults. Without a stored curve it is made
+// from the threshold and dim level.
+//
+void LoadSettings(void) {
+	record_t r;
+	uint8_t found=0;
+	uint8_t i;
+
+	for (i=0; i<SETTINGS_SLOTS; i++) {
+		eeprom_read_block(&r, SlotAddress(i), sizeof(r));
+		if (!RecordValid(&r)) continue;
+		if (found && (int8_t)(r.seq-record.seq)<=0) continue;
+		record=r;
+		slot=i;
+		found=1;
+	}
+
+	if (found) {
+		brightnessThreshold=record.threshold;
+		dimLevel=record.level;
+	} else {
+		slot=SETTINGS_SLOTS-1;
+		brightnessThreshold=eeprom_read_byte((uint8_t *)LEGACY_THRESHOLD);
+		dimLevel=eeprom_read_byte((uint8_t *)LEGACY_LEVEL);
+	}
+
+	if (brightnessThreshold<THRESHOLD_MIN || brightnessThreshold>THRESHOLD_MAX) {
+		brightnessThreshold=THRESHOLD_DEFAULT;
+	}
+	if (dimLevel>LEVEL_MAX) dimLevel=LEVEL_DEFAULT;
+
+	if (found && record.version==SETTINGS_VERSION) {
+		for (i=0; i<CURVE_POINTS; i++) {
+			brightnessCurve[i]=record.curve[i]>BRIGHT_MAX ? BRIGHT_MAX : record.curve[i];
+		}
+	} else {
+		MakeCurve();
+	}
+}
+
+
+
+//
+// Set the curve to the old two level behaviour from the threshold and
+// dim level: full brightness from the threshold up, dimmed below it.
+// The interpolation turns the step into a ramp over one curve segment.
+//
+void MakeCurve(void) {
+	uint8_t i;
+
+	for (i=0; i<CURVE_POINTS; i++) {
+		if (((uint16_t)i<<CURVE_SHIFT)>=(brightnessThreshold+1)*10) {
+			brightnessCurve[i]=BRIGHT_MAX;
+		} else {
+			brightnessCurve[i]=DIM_TO_LEVEL(dimLevel);
+		}
+	}
+}
+
+
+
+//
+// Write the current settings in the background. A save made while one
+// is in progress is written once that is done.
+//
+void SaveSettings(void) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if (writeIndex<sizeof(record_t)) {
+			savePending=1;
+		} else {
+			StartWrite();
+		}
+	}
+}
+
+
+
+//
+// True while a record is being written
+//
+uint8_t SettingsBusy(void) {
+	return writeIndex<sizeof(record_t) || savePending;
+}
@@ -0,0 +1,40 @@
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include <stdint.h>
+
+// The settings are stored as a record with a sequence number and a CRC.
+// Each save goes to the next slot in a ring, so the wear is spread over
+// SETTINGS_SLOTS slots, and the valid record with the highest sequence
+// number is loaded at start.
+#define SETTINGS_BASE		0x20
+#define SETTINGS_SLOT_SIZE	16
+#define SETTINGS_SLOTS		8
+
+// Changed whenever the record layout changes. Version 1 records are
+// still read, anything else is ignored and the defaults used.
+#define SETTINGS_VERSION	2
+
+// Brightness curve: the level at LDR readings 0, 128, .. 1024, with
+// straight lines in between
+#define CURVE_SHIFT		7
+#define CURVE_POINTS		((1024>>CURVE_SHIFT)+1)
+
+// Defaults and limits
+#define THRESHOLD_DEFAULT	50
+#define THRESHOLD_MIN		1
+#define THRESHOLD_MAX		99
+#define LEVEL_DEFAULT		16
+#define LEVEL_MAX		16
+
+// Current settings
+extern uint8_t brightnessThreshold;	// LDR level for full brightness, in tenths
+extern uint8_t dimLevel;		// Dimming step below the threshold
+extern uint8_t brightnessCurve[CURVE_POINTS];
+
+void LoadSettings(void);
+void SaveSettings(void);
+void MakeCurve(void);
+uint8_t SettingsBusy(void);
+
+#endif
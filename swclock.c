@@ -0,0 +1,346 @@
+//
+//	swclock.c - Software clock resynchronised from the RTC
+//
+//    The time is advanced locally once a second by a scheduler task
+//    and only read from the RTC every RTC_RESYNC_PERIOD seconds. To
+//    line the local seconds up with the RTC, a resync polls the seconds
+//    register every RESYNC_POLL ms until it changes and restarts the
+//    second task at that moment. The difference between the local time
+//    and the RTC is kept in clockDrift each time, in ms.
+//
+//    A full resync, at start and after the time is set, starts polling
+//    at once and can take up to a second of reads. The time is shown
+//    from the first of them. A periodic resync expects the RTC second
+//    where the last drift puts it and starts polling just before, so it
+//    normally takes a handful of reads. If the second has already gone
+//    by, it waits for the next one and widens the window for next time.
+//
+//    With RTC_MFP the RTC drives the seconds instead: its 1Hz output
+//    wakes the second task from the pin change interrupt, and the
+//    resync is a plain read done on that edge.
+//
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "twi.h"
+#include "rtc.h"
+#include "sched.h"
+#include "bcd.h"
+#include "swclock.h"
+
+// Interval between RTC reads while waiting for the seconds to change,
+// and before trying again after a failed read
+#define RESYNC_POLL	10
+#define RESYNC_RETRY	1000
+
+// Range of how long before the expected RTC second a periodic resync
+// starts reading, ms
+#define RESYNC_MARGIN_MIN	20
+#define RESYNC_MARGIN_MAX	400
+
+volatile uint8_t second;
+volatile uint8_t minute;
+volatile uint8_t hour;
+uint8_t date;
+uint8_t month;
+uint8_t year;
+
+int16_t clockDrift;
+uint16_t clockResyncs;
+
+static void (*showTime)(void);
+static uint8_t secondTask=NO_TASK;
+static uint8_t resyncCountdown;
+static uint8_t valid;			// Local time has been set at least once
+#ifndef RTC_MFP
+static uint8_t resyncRef;		// Seconds register when the resync started
+static uint8_t resyncing;
+static uint8_t resyncTimed;		// Started just ahead of the expected second
+static uint8_t resyncRestart;		// Time was set during the resync
+static uint16_t resyncStart;		// GetMillis() of the first read
+static uint16_t resyncMargin=RESYNC_MARGIN_MIN;
+static uint16_t tickTime;		// GetMillis() when the local second started
+
+static void ResyncRead(void);
+static void ResyncCheck(void);
+static void StartResync(void);
+#endif
+static void CopyFromRTC(void);
+static void LoadFromRTC(void);
+
+
+
+//
+// Days in the current month in BCD, good for 2000-2099. As 10 is 2
+// modulo 4 the year is a leap year when 2*tens+ones is a multiple of 4.
+//
+static uint8_t DaysInMonth(void) {
+	if (month==0x02) return ((2*BCD_TENS(year)+BCD_ONES(year))&3) ? 0x28 : 0x29;
+	if (month==0x04 || month==0x06 || month==0x09 || month==0x11) return 0x30;
+	return 0x31;
+}
+
+
+
+//
+// Advance the local time by one second
+//
+static void TickSecond(void) {
+	if ((second=BcdInc(second))<0x60) return;
+	second=0;
+	if ((minute=BcdInc(minute))<0x60) return;
+	minute=0;
+	if ((hour=BcdInc(hour))<0x24) return;
+	hour=0;
+	if ((date=BcdInc(date))<=DaysInMonth()) return;
+	date=1;
+	if ((month=BcdInc(month))<=0x12) return;
+	month=1;
+	year=BcdIncWrap(year,0x00,0x99);
+}
+
+
+
+//
+// Seconds since midnight, only used for the drift statistics
+//
+static int32_t DaySeconds(uint8_t h, uint8_t m, uint8_t s) {
+	return (int32_t)BcdToBin(h)*3600+BcdToBin(m)*60+BcdToBin(s);
+}
+
+
+
+#ifdef RTC_MFP
+//
+// Edge on the RTC's square wave output
+//
+ISR(PCINT1_vect) {
+#ifdef MFP_RISING
+	if (PINC & _BV(MFP_PIN)) WakeTask(secondTask);
+#else
+	if (!(PINC & _BV(MFP_PIN))) WakeTask(secondTask);
+#endif
+}
+
+
+
+//
+// Runs on each MFP edge. The time is read from the RTC every
+// RTC_RESYNC_PERIOD seconds and counted locally in between.
+//
+static void SecondTask(void) {
+	if (resyncCountdown) resyncCountdown--;
+	if (!resyncCountdown && RefreshRTCImage()==TWI_OK) {
+		LoadFromRTC();
+	} else {
+		TickSecond();
+	}
+	if (showTime) showTime();
+}
+#else
+//
+// Runs once a second
+//
+static void SecondTask(void) {
+	tickTime=GetMillis();
+	TickSecond();
+	if (showTime) showTime();
+
+	if (resyncCountdown) resyncCountdown--;
+	if (!resyncCountdown) StartResync();
+}
+#endif
+
+
+
+//
+// Start keeping time. show is called every time the seconds change.
+//
+void StartClock(void (*show)(void)) {
+	showTime=show;
+#ifdef RTC_MFP
+	WriteRTCByte(RTC_CONTROL, RTC_SQWEN | RTC_SQW_1HZ);
+	// Show the time now rather than on the first edge
+	if (RefreshRTCImage()==TWI_OK) {
+		CopyFromRTC();
+		if (showTime) showTime();
+	}
+	PORTC|=_BV(MFP_PIN);		// MFP is open drain, pull it up
+	secondTask=AddTask(SecondTask, MFP_TIMEOUT, MFP_TIMEOUT);
+	PCMSK1|=_BV(MFP_PIN);		// PC2 is PCINT10
+	PCICR|=_BV(PCIE1);
+#else
+	ResyncClock();
+#endif
+}
+
+
+
+//
+// Read the time from the RTC again, lining up the local seconds with it
+//
+void ResyncClock(void) {
+#ifdef RTC_MFP
+	// Done on the next edge
+	resyncCountdown=0;
+#else
+	if (resyncing) {
+		// A read under way may be from before the time was set
+		resyncRestart=1;
+		return;
+	}
+	resyncing=1;
+	resyncTimed=0;
+	resyncRestart=0;
+	resyncRef=0xff;
+	ResyncRead();
+#endif
+}
+
+
+
+#ifndef RTC_MFP
+//
+// Run the next step of the resync after delay ms. If the task table is
+// full the resync is dropped, and the second task starts it over.
+//
+static void ResyncLater(void (*run)(void), uint16_t delay) {
+	if (AddTask(run, delay, 0)==NO_TASK) resyncing=0;
+}
+
+
+
+//
+// Periodic resync, called on a local second. The RTC second is expected
+// clockDrift ms before this one, and reading starts resyncMargin ms
+// ahead of that.
+//
+static void StartResync(void) {
+	int16_t lead;
+
+	if (resyncing) return;
+	resyncing=1;
+	resyncTimed=1;
+	resyncRestart=0;
+	resyncRef=0xff;
+	lead=((int32_t)clockDrift+resyncMargin)%1000;
+	if (lead<0) lead+=1000;
+	ResyncLater(ResyncRead, (1000-lead)%1000);
+}
+
+
+
+//
+// Start reading the RTC and check the result once the transfer is done
+//
+static void ResyncRead(void) {
+	StartRTCRefresh();
+	ResyncLater(ResyncCheck, 2);
+}
+
+
+
+//
+// Take over the time from the RTC if its seconds just changed,
+// otherwise poll again
+//
+static void ResyncCheck(void) {
+	uint8_t err;
+
+	err=FinishRTCRefresh();
+	if (resyncRestart) {
+		resyncRestart=0;
+		resyncTimed=0;
+		resyncRef=0xff;
+		ResyncLater(ResyncRead, 0);
+		return;
+	}
+	if (err!=TWI_OK) {
+		resyncRef=0xff;
+		ResyncLater(ResyncRead, RESYNC_RETRY);
+		return;
+	}
+
+	if (resyncRef==0xff) {
+		resyncRef=rtcImage[RTC_SECONDS];
+		resyncStart=GetMillis();
+		// Nothing to show yet at start, use this read until the edge
+		if (!valid) {
+			CopyFromRTC();
+			if (showTime) showTime();
+		}
+		ResyncLater(ResyncRead, RESYNC_POLL);
+		return;
+	}
+	if (rtcImage[RTC_SECONDS]==resyncRef) {
+		ResyncLater(ResyncRead, RESYNC_POLL);
+		return;
+	}
+
+	// Polling longer than the window means the first read came after
+	// the second it was meant to catch
+	if (resyncTimed) {
+		if ((uint16_t)(GetMillis()-resyncStart)>2*resyncMargin) {
+			resyncMargin*=2;
+			if (resyncMargin>RESYNC_MARGIN_MAX) resyncMargin=RESYNC_MARGIN_MAX;
+		} else if (resyncMargin>RESYNC_MARGIN_MIN) {
+			resyncMargin-=resyncMargin/4;
+		}
+	}
+
+	// The RTC second has just started, restart the local second here
+	LoadFromRTC();
+	StopTask(secondTask);
+	secondTask=AddTask(SecondTask, 1000, 1000);
+	tickTime=GetMillis();
+	resyncing=0;
+	if (showTime) showTime();
+}
+#endif
+
+
+
+//
+// Copy the time in rtcImage[] to the local clock
+//
+static void CopyFromRTC(void) {
+	// Mask off the control bits sharing the registers
+	second=rtcImage[RTC_SECONDS]&0x7f;
+	minute=rtcImage[RTC_MINUTES]&0x7f;
+	hour=rtcImage[RTC_HOURS]&0x3f;
+	date=rtcImage[RTC_DATE]&0x3f;
+	month=rtcImage[RTC_MONTH]&0x1f;
+	year=rtcImage[RTC_YEAR];
+}
+
+
+
+//
+// Take over the time in rtcImage[], read at the start of an RTC second,
+// noting how far off the local time was
+//
+static void LoadFromRTC(void) {
+	int32_t diff;
+
+	if (valid) {
+		diff=DaySeconds(rtcImage[RTC_HOURS]&0x3f, rtcImage[RTC_MINUTES]&0x7f,
+				rtcImage[RTC_SECONDS]&0x7f)-DaySeconds(hour, minute, second);
+		if (diff>43200) diff-=86400;
+		if (diff<-43200) diff+=86400;
+		diff*=1000;
+#ifndef RTC_MFP
+		// The local second had been running this long
+		diff-=(uint16_t)(GetMillis()-tickTime);
+#endif
+		if (diff>INT16_MAX) diff=INT16_MAX;
+		if (diff<INT16_MIN) diff=INT16_MIN;
+		clockDrift=diff;
+		clockResyncs++;
+	}
+
+	CopyFromRTC();
+	valid=1;
+
+	resyncCountdown=RTC_RESYNC_PERIOD;
+}
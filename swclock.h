@@ -0,0 +1,37 @@
+#ifndef SWCLOCK_H
+#define SWCLOCK_H
+
+#include <stdint.h>
+
+// Seconds between resyncs from the RTC. The tick comes from the
+// internal RC oscillator, which is only good to about 1%, so this
+// shouldn't be much longer than a minute or two.
+#ifndef RTC_RESYNC_PERIOD
+#define RTC_RESYNC_PERIOD	60
+#endif
+
+// With RTC_MFP defined the seconds are counted from the RTC's 1Hz
+// square wave on the MFP pin, wired to PC2 (PCINT10). The time is then
+// advanced on the falling edge, or the rising edge with MFP_RISING.
+#define MFP_PIN		2
+
+// Longest wait for an MFP edge before counting the second anyway, ms
+#define MFP_TIMEOUT	1100
+
+// Time of day and date, kept locally in packed BCD
+extern volatile uint8_t second;
+extern volatile uint8_t minute;
+extern volatile uint8_t hour;
+extern uint8_t date;
+extern uint8_t month;
+extern uint8_t year;
+
+// Milliseconds the RTC was ahead of the local clock at the last resync,
+// limited to the int16_t range, and the number of resyncs done
+extern int16_t clockDrift;
+extern uint16_t clockResyncs;
+
+void StartClock(void (*show)(void));
+void ResyncClock(void);
+
+#endif
@@ -1,15 +1,23 @@
 #include <util/delay_basic.h>
 #include <avr/interrupt.h>
+#include <avr/sleep.h>
 #include <compat/twi.h>
 
 #include "twi.h"
-
-static void (*twi_onSlaveTransmit)(void);
-static void (*twi_onSlaveReceive)(uint8_t*, int);
+#include "sched.h"
 
 static uint8_t twi_masterBuffer[TWI_BUFFER_LENGTH];
+static twi_txn twi_masterTxn;
+
+static twi_txn* volatile twi_queue[TWI_QUEUE_LENGTH];
+static volatile uint8_t twi_queueHead;
+static volatile uint8_t twi_queueCount;
+static twi_txn* twi_current;
 static volatile uint8_t twi_masterBufferIndex;
-static uint8_t twi_masterBufferLength;
+
+#ifdef TWI_SLAVE
+static void (*twi_onSlaveTransmit)(void);
+static void (*twi_onSlaveReceive)(uint8_t*, int);
 
 static uint8_t twi_txBuffer[TWI_BUFFER_LENGTH];
 static volatile uint8_t twi_txBufferIndex;
@@ -18,7 +26,11 @@ static volatile uint8_t twi_txBufferLength;
 static uint8_t twi_rxBuffer[TWI_BUFFER_LENGTH];
 static volatile uint8_t twi_rxBufferIndex;
 
-static volatile uint8_t twi_error;
+// answer to our own address only when built with slave support
+#define TWI_EA (1<<TWEA)
+#else
+#define TWI_EA 0
+#endif
 
 uint8_t rxBuffer[BUFFER_LENGTH];
 uint8_t rxBufferIndex = 0;
@@ -34,6 +46,26 @@ uint8_t transmitting = 0;
 static volatile uint8_t twi_state;
 static uint8_t twi_slarw;
 
+// twi_masterBufferIndex value while the register address is still to go
+#define TWI_INDEX_REG 0xFF
+
+// _delay_loop_1 count for one TWI_POLL_US clock period in twi_recover,
+// 3 cycles per count
+#define TWI_POLL_LOOPS ((F_CPU / 1000000L) * TWI_POLL_US / 3)
+
+// bit rate settings, kept so twi_init can restore them after a recovery
+static uint8_t twi_twbr = ((F_CPU / TWI_FREQ) - 16) / 2;
+static uint8_t twi_twps = 0;
+
+// transactions that ended in an error, for the statistics
+static volatile uint16_t twi_errorCount;
+
+// ms a blocking call waits, rounded up
+static uint16_t twi_timeout = (TWI_TIMEOUT_US + 999) / 1000;
+
+static void twi_start(void);
+static void twi_finish(uint8_t status);
+
 
 // !!!
 void begin(void) {
@@ -157,21 +189,319 @@ void twi_init(void) {
   PORTC |= (1<<5);
 
   // initialize twi prescaler and bit rate
-  TWSR&= ~(1<<TWPS0);
-  TWSR&= ~(1<<TWPS1);
-  TWBR = ((F_CPU / TWI_FREQ) - 16) / 2;
-
-  /* twi bit rate formula from atmega128 manual pg 204
-  SCL Frequency = CPU Clock Frequency / (16 + (2 * TWBR))
-  note: TWBR should be 10 or higher for master mode
-  It is 72 for a 16mhz Wiring board with 100kHz TWI */
+  TWSR = twi_twps;
+  TWBR = twi_twbr;
 
   // enable twi module, acks, and twi interrupt
-  TWCR = (1<<TWEN) | (1<<TWIE) | (1<<TWEA);
+  TWCR = (1<<TWEN) | (1<<TWIE) | TWI_EA;
+}
+
+
+
+
+/* 
+ * Function twi_setFrequency
+ * Desc     selects the bus speed, computing prescaler and bit rate
+ *          from F_CPU. The speed is rounded down to the nearest one the
+ *          hardware can make. Only call while the bus is idle.
+ * Input    frequency: SCL frequency in Hz, at most TWI_FREQ_FAST
+ * Output   0 .. success
+ *          1 .. frequency can't be made from F_CPU, nothing changed
+ */
+uint8_t twi_setFrequency(uint32_t frequency) {
+  uint32_t div;
+  uint8_t ps;
+
+  /* twi bit rate formula from atmega48 manual
+  SCL Frequency = CPU Clock Frequency / (16 + (2 * TWBR * 4^TWPS))
+  so the CPU clock must be at least 16 times the SCL frequency */
+  if(0 == frequency || TWI_FREQ_FAST < frequency){
+    return 1;
+  }
+  div = (F_CPU + frequency - 1) / frequency;
+  if(16 > div){
+    return 1;
+  }
+  div = (div - 16 + 1) / 2;
+
+  // use the smallest prescaler that gets TWBR into range
+  for(ps = 0; 255 < div; ps++){
+    if(3 == ps){
+      return 1;
+    }
+    div = (div + 3) / 4;
+  }
+
+  twi_twps = ps;
+  twi_twbr = div;
+  TWSR = twi_twps;
+  TWBR = twi_twbr;
+  return 0;
+}
+
+/* 
+ * Function twi_submit
+ * Desc     queues a transaction and returns at once, the transfer
+ *          runs entirely from the twi interrupt
+ * Input    txn: transaction to run, owned by the driver until its
+ *               status changes from TWI_PENDING
+ * Output   0 .. queued
+ *          1 .. queue full, or a TWI_TXN_READ of no bytes
+ */
+uint8_t twi_submit(twi_txn* txn) {
+  uint8_t sreg;
+
+  // the last byte of a read is always stored
+  if((txn->flags & TWI_TXN_READ) && 0 == txn->rxLength){
+    txn->status = TWI_EOTHER;
+    return 1;
+  }
+  txn->status = TWI_PENDING;
+
+  sreg = SREG;
+  cli();
+  if(twi_queueCount >= TWI_QUEUE_LENGTH){
+    SREG = sreg;
+    txn->status = TWI_EOTHER;
+    return 1;
+  }
+  twi_queue[(twi_queueHead + twi_queueCount) % TWI_QUEUE_LENGTH] = txn;
+  twi_queueCount++;
+  // kick off the bus if nothing else is running. If the last stop is
+  // still going out, TWSTO is kept set and the start follows it
+  if(TWI_READY == twi_state || TWI_STOPPING == twi_state){
+    twi_start();
+    TWCR = (1<<TWEN) | (1<<TWIE) | TWI_EA | (1<<TWINT) | (TWCR & (1<<TWSTO)) | (1<<TWSTA);
+  }
+  SREG = sreg;
+  return 0;
+}
+
+/* 
+ * Function twi_wait
+ * Desc     waits until a submitted transaction has completed, sleeping
+ *          in idle mode. If that takes longer than the timeout the bus
+ *          is assumed to be hung, everything queued is failed and the
+ *          bus is recovered. Needs interrupts enabled.
+ * Input    txn: transaction passed to twi_submit
+ * Output   status of the transaction, see twi_writeTo
+ */
+uint8_t twi_wait(twi_txn* txn) {
+  uint16_t start = GetMillis();
+
+  while(TWI_PENDING == txn->status){
+    // the first tick can come right away, so wait one more
+    if((uint16_t)(GetMillis() - start) > twi_timeout){
+      twi_recover();
+      break;
+    }
+    // the twi and display interrupts wake the cpu
+    schedIdle = 1;
+    sleep_mode();
+    schedIdle = 0;
+  }
+  return txn->status;
 }
 
+/* 
+ * Function twi_setTimeout
+ * Desc     sets how long blocking calls wait for the bus
+ * Input    us: timeout in microseconds, counted in whole ms
+ * Output   none
+ */
+void twi_setTimeout(uint16_t us) {
+  twi_timeout = (us + 999UL) / 1000;
+}
+
+/* 
+ * Function twi_getErrorCount
+ * Desc     number of transactions that failed or timed out since start
+ * Input    none
+ * Output   error count, wraps at 65535
+ */
+uint16_t twi_getErrorCount(void) {
+  uint16_t n;
+  uint8_t sreg;
+
+  sreg = SREG;
+  cli();
+  n = twi_errorCount;
+  SREG = sreg;
+  return n;
+}
+
+/* 
+ * Function twi_recover
+ * Desc     fails all queued transactions with TWI_ETIMEOUT and frees a
+ *          bus held low by a slave that lost track of the clock: SCL is
+ *          pulsed until SDA is released (at most nine times), a STOP is
+ *          generated by hand and the twi module is started over.
+ * Input    none
+ * Output   none
+ */
+void twi_recover(void) {
+  uint8_t sreg;
+  uint8_t i;
+  twi_txn* txn;
+
+  sreg = SREG;
+  cli();
+
+  // disconnect the twi module from the pins
+  TWCR = 0;
+
+  while(twi_queueCount){
+    txn = twi_queue[twi_queueHead];
+    twi_queueHead = (twi_queueHead + 1) % TWI_QUEUE_LENGTH;
+    twi_queueCount--;
+    txn->status = TWI_ETIMEOUT;
+    twi_errorCount++;
+    if(txn->callback){
+      txn->callback(txn);
+    }
+  }
+
+  // SCL is driven open drain by switching between output low and
+  // input with pull-up
+  for(i = 0; i < 9 && !(PINC & (1<<4)); i++){
+    PORTC &= ~(1<<5);
+    DDRC |= (1<<5);
+    _delay_loop_1(TWI_POLL_LOOPS / 2);
+    DDRC &= ~(1<<5);
+    PORTC |= (1<<5);
+    _delay_loop_1(TWI_POLL_LOOPS / 2);
+  }
+
+  // stop condition: SDA goes high while SCL is high
+  PORTC &= ~(1<<4);
+  DDRC |= (1<<4);
+  _delay_loop_1(TWI_POLL_LOOPS / 2);
+  DDRC &= ~(1<<4);
+  PORTC |= (1<<4);
+  _delay_loop_1(TWI_POLL_LOOPS / 2);
+
+  twi_init();
+  SREG = sreg;
+}
+
+/* 
+ * Function twi_start
+ * Desc     takes the transaction at the head of the queue and sets up
+ *          for its first phase. Caller sends the start condition.
+ *          Called with interrupts disabled.
+ */
+static void twi_start(void) {
+  twi_current = twi_queue[twi_queueHead];
+  twi_masterBufferIndex = (twi_current->flags & TWI_TXN_REG) ? TWI_INDEX_REG : 0;
+
+  // build sla+w or sla+r, slave device address + r/w bit
+  twi_slarw = twi_current->address << 1;
+  if(twi_current->flags & TWI_TXN_READ){
+    twi_slarw |= TW_READ;
+    twi_state = TWI_MRX;
+  }else{
+    twi_slarw |= TW_WRITE;
+    twi_state = TWI_MTX;
+  }
+}
+
+/* 
+ * Function twi_finish
+ * Desc     completes the running transaction and moves on to the next
+ *          one in the queue, or releases the bus if there is none
+ * Input    status: result to report, see twi_writeTo
+ */
+static void twi_finish(uint8_t status) {
+  twi_txn* txn = twi_current;
+  uint8_t arbLost = (TW_MT_ARB_LOST == TW_STATUS);
+
+  txn->rxLength = (TWI_MRX == twi_state) ? twi_masterBufferIndex : 0;
+  if(status){
+    twi_errorCount++;
+  }
+
+  twi_queueHead = (twi_queueHead + 1) % TWI_QUEUE_LENGTH;
+  twi_queueCount--;
+
+  if(twi_queueCount){
+    // stop followed by start for the next transaction, or just a start
+    // once the bus is free if we are no longer master
+    twi_start();
+    if(arbLost){
+      TWCR = (1<<TWEN) | (1<<TWIE) | TWI_EA | (1<<TWINT) | (1<<TWSTA);
+    }else{
+      TWCR = (1<<TWEN) | (1<<TWIE) | TWI_EA | (1<<TWINT) | (1<<TWSTO) | (1<<TWSTA);
+    }
+  }else if(arbLost){
+    twi_releaseBus();
+  }else{
+    twi_stop();
+  }
+
+  txn->status = status;
+  if(txn->callback){
+    txn->callback(txn);
+  }
+}
 
+/* 
+ * Function twi_readRegs
+ * Desc     reads a block of registers from a device: the register
+ *          address is written, then the data is read after a repeated
+ *          start straight into the caller's buffer
+ * Input    address: 7bit i2c device address
+ *          reg: first register to read
+ *          data: pointer to byte array
+ *          length: number of bytes to read into array
+ * Output   status, see twi_writeTo
+ */
+uint8_t twi_readRegs(uint8_t address, uint8_t reg, uint8_t* data, uint8_t length) {
+  twi_txn txn;
+
+  txn.address = address;
+  txn.flags = TWI_TXN_REG;
+  txn.reg = reg;
+  txn.txLength = 0;
+  txn.rxData = data;
+  txn.rxLength = length;
+  txn.callback = 0;
+
+  if(twi_submit(&txn)){
+    return TWI_EOTHER;
+  }
+  twi_wait(&txn);
+  if(TWI_OK == txn.status && txn.rxLength != length){
+    return TWI_EOTHER;
+  }
+  return txn.status;
+}
 
+/* 
+ * Function twi_writeRegs
+ * Desc     writes a block of registers in a device in one transaction,
+ *          sending the data straight from the caller's buffer
+ * Input    address: 7bit i2c device address
+ *          reg: first register to write
+ *          data: pointer to byte array
+ *          length: number of bytes in array
+ * Output   status, see twi_writeTo
+ */
+uint8_t twi_writeRegs(uint8_t address, uint8_t reg, const uint8_t* data, uint8_t length) {
+  twi_txn txn;
+
+  txn.address = address;
+  txn.flags = TWI_TXN_REG;
+  txn.reg = reg;
+  txn.txData = data;
+  txn.txLength = length;
+  txn.rxLength = 0;
+  txn.callback = 0;
+
+  if(twi_submit(&txn)){
+    return TWI_EOTHER;
+  }
+  return twi_wait(&txn);
+}
 
 /* 
  * Function twi_readFrom
@@ -184,51 +514,25 @@ void twi_init(void) {
  */
 // !!!
 uint8_t twi_readFrom(uint8_t address, uint8_t* data, uint8_t length) {
-  uint8_t i;
+  twi_txn txn;
 
-  // ensure data will fit into buffer
-  if(TWI_BUFFER_LENGTH < length){
+  if(0 == length){
     return 0;
   }
 
-  // wait until twi is ready, become master receiver
-  while(TWI_READY != twi_state){
-    continue;
-  }
-  twi_state = TWI_MRX;
-  // reset error state (0xFF.. no error occured)
-  twi_error = 0xFF;
-
-  // initialize buffer iteration vars
-  twi_masterBufferIndex = 0;
-  twi_masterBufferLength = length-1;  // This is not intuitive, read on...
-  // On receive, the previously configured ACK/NACK setting is transmitted in
-  // response to the received byte before the interrupt is signalled. 
-  // Therefor we must actually set NACK when the _next_ to last byte is
-  // received, causing that NACK to be sent in response to receiving the last
-  // expected byte of data.
-
-  // build sla+w, slave device address + w bit
-  twi_slarw = TW_READ;
-  twi_slarw |= address << 1;
-
-  // send start condition
-  TWCR = (1<<TWEN) | (1<<TWIE) | (1<<TWEA) | (1<<TWINT) | (1<<TWSTA);
-
-  // wait for read operation to complete
-  while(TWI_MRX == twi_state){
-    continue;
-  }
+  txn.address = address;
+  txn.flags = TWI_TXN_READ;
+  txn.txLength = 0;
+  txn.rxData = data;
+  txn.rxLength = length;
+  txn.callback = 0;
 
-  if (twi_masterBufferIndex < length)
-    length = twi_masterBufferIndex;
-
-  // copy twi buffer to data
-  for(i = 0; i < length; ++i){
-    data[i] = twi_masterBuffer[i];
+  if(twi_submit(&txn)){
+    return 0;
   }
-	
-  return length;
+  twi_wait(&txn);
+
+  return txn.rxLength;
 }
 
 /* 
@@ -247,51 +551,117 @@ uint8_t twi_readFrom(uint8_t address, uint8_t* data, uint8_t length) {
  */
 // !!!
 uint8_t twi_writeTo(uint8_t address, uint8_t* data, uint8_t length, uint8_t wait) {
+  twi_txn stackTxn;
+  twi_txn* txn = &stackTxn;
+  uint8_t i;
+
+  if(!wait){
+    // the data must outlive the call, so it goes through the master
+    // buffer, which may still be in use by the previous write
+    if(TWI_BUFFER_LENGTH < length){
+      return 1;
+    }
+    txn = &twi_masterTxn;
+    twi_wait(txn);
+    for(i = 0; i < length; ++i){
+      twi_masterBuffer[i] = data[i];
+    }
+    data = twi_masterBuffer;
+  }
+
+  txn->address = address;
+  txn->flags = 0;
+  txn->txData = data;
+  txn->txLength = length;
+  txn->rxData = 0;
+  txn->rxLength = 0;
+  txn->callback = 0;
+
+  if(twi_submit(txn)){
+    return 4;
+  }
+  if(!wait){
+    return 0;
+  }
+  return twi_wait(txn);
+}
+
+#ifdef TWI_SLAVE
+/* 
+ * Function twi_setAddress
+ * Desc     sets slave address and enables interrupt
+ * Input    none
+ * Output   none
+ */
+void twi_setAddress(uint8_t address) {
+  // set twi slave address (skip over TWGCE bit)
+  TWAR = address << 1;
+}
+
+/* 
+ * Function twi_transmit
+ * Desc     fills slave tx buffer with data
+ *          must be called in slave tx event callback
+ * Input    data: pointer to byte array
+ *          length: number of bytes in array
+ * Output   1 length too long for buffer
+ *          2 not slave transmitter
+ *          0 ok
+ */
+uint8_t twi_transmit(uint8_t* data, uint8_t length) {
   uint8_t i;
 
   // ensure data will fit into buffer
   if(TWI_BUFFER_LENGTH < length){
     return 1;
   }
-
-  // wait until twi is ready, become master transmitter
-  while(TWI_READY != twi_state){
-    continue;
+  
+  // ensure we are currently a slave transmitter
+  if(TWI_STX != twi_state){
+    return 2;
   }
-  twi_state = TWI_MTX;
-  // reset error state (0xFF.. no error occured)
-  twi_error = 0xFF;
-
-  // initialize buffer iteration vars
-  twi_masterBufferIndex = 0;
-  twi_masterBufferLength = length;
   
-  // copy data to twi buffer
+  // set length and copy data into tx buffer
+  twi_txBufferLength = length;
   for(i = 0; i < length; ++i){
-    twi_masterBuffer[i] = data[i];
+    twi_txBuffer[i] = data[i];
   }
   
-  // build sla+w, slave device address + w bit
-  twi_slarw = TW_WRITE;
-  twi_slarw |= address << 1;
-  
-  // send start condition
-  TWCR = (1<<TWEN) | (1<<TWIE) | (1<<TWEA) | (1<<TWINT) | (1<<TWSTA);
+  return 0;
+}
+
+/* 
+ * Function twi_attachSlaveRxEvent
+ * Desc     sets function called before a slave read operation
+ * Input    function: callback function to use
+ * Output   none
+ */
+void twi_attachSlaveRxEvent( void (*function)(uint8_t*, int) ) {
+  twi_onSlaveReceive = function;
+}
+
+/* 
+ * Function twi_attachSlaveTxEvent
+ * Desc     sets function called before a slave write operation
+ * Input    function: callback function to use
+ * Output   none
+ */
+void twi_attachSlaveTxEvent( void (*function)(void) ) {
+  twi_onSlaveTransmit = function;
+}
 
-  // wait for write operation to complete
-  while(wait && (TWI_MTX == twi_state)){
-    continue;
+/* 
+ * Function twi_resume
+ * Desc     starts the next queued master transaction once a slave
+ *          transfer has released the bus
+ */
+static void twi_resume(void) {
+  if(twi_queueCount){
+    twi_start();
+    TWCR = (1<<TWEN) | (1<<TWIE) | TWI_EA | (1<<TWINT) | (1<<TWSTA);
   }
-  
-  if (twi_error == 0xFF)
-    return 0;	// success
-  else if (twi_error == TW_MT_SLA_NACK)
-    return 2;	// error: address send, nack received
-  else if (twi_error == TW_MT_DATA_NACK)
-    return 3;	// error: data send, nack received
-  else
-    return 4;	// other twi error
 }
+#endif
 
 /* 
  * Function twi_reply
@@ -311,26 +681,22 @@ void twi_reply(uint8_t ack) {
 
 /* 
  * Function twi_stop
- * Desc     relinquishes bus master status
+ * Desc     relinquishes bus master status. Returns as soon as the stop
+ *          is requested, the hardware clears TWSTO once it is on the
+ *          bus and no interrupt follows. twi_submit picks that up, so
+ *          nothing waits for the bus inside the interrupt.
  * Input    none
  * Output   none
  */
 // !!!
 void twi_stop(void) {
   // send stop condition
-  TWCR = (1<<TWEN) | (1<<TWIE) | (1<<TWEA) | (1<<TWINT) | (1<<TWSTO);
-
-  // wait for stop condition to be exectued on bus
-  // TWINT is not set after a stop condition!
-  while(TWCR & (1<<TWSTO)){
-    continue;
-  }
+  TWCR = (1<<TWEN) | (1<<TWIE) | TWI_EA | (1<<TWINT) | (1<<TWSTO);
 
   // update twi state
-  twi_state = TWI_READY;
+  twi_state = TWI_STOPPING;
 }
 
-
 /* 
  * Function twi_releaseBus
  * Desc     releases bus control
@@ -340,7 +706,7 @@ void twi_stop(void) {
 // !!!
 void twi_releaseBus(void) {
   // release bus
-  TWCR = (1<<TWEN) | (1<<TWIE) | (1<<TWEA) | (1<<TWINT);
+  TWCR = (1<<TWEN) | (1<<TWIE) | TWI_EA | (1<<TWINT);
 
   // update twi state
   twi_state = TWI_READY;
@@ -363,35 +729,47 @@ SIGNAL(TWI_vect) {
     // Master Transmitter
     case TW_MT_SLA_ACK:  // slave receiver acked address
     case TW_MT_DATA_ACK: // slave receiver acked data
-      // if there is data to send, send it, otherwise stop 
-      if(twi_masterBufferIndex < twi_masterBufferLength){
+      // if there is data to send, send it, otherwise go on to the read
+      // phase with a repeated start, or stop
+      if(TWI_INDEX_REG == twi_masterBufferIndex){
+        // register address goes ahead of the data
+        TWDR = twi_current->reg;
+        twi_masterBufferIndex = 0;
+        twi_reply(1);
+      }else if(twi_masterBufferIndex < twi_current->txLength){
         // copy data to output register and ack
-        TWDR = twi_masterBuffer[twi_masterBufferIndex++];
+        TWDR = twi_current->txData[twi_masterBufferIndex++];
         twi_reply(1);
+      }else if(twi_current->rxLength){
+        twi_masterBufferIndex = 0;
+        twi_slarw |= TW_READ;
+        twi_state = TWI_MRX;
+        TWCR = (1<<TWEN) | (1<<TWIE) | TWI_EA | (1<<TWINT) | (1<<TWSTA);
       }else{
-        twi_stop();
+        twi_finish(0);
       }
       break;
     case TW_MT_SLA_NACK:  // address sent, nack received
-      twi_error = TW_MT_SLA_NACK;
-      twi_stop();
+      twi_finish(2);
       break;
     case TW_MT_DATA_NACK: // data sent, nack received
-      twi_error = TW_MT_DATA_NACK;
-      twi_stop();
+      twi_finish(3);
       break;
     case TW_MT_ARB_LOST: // lost bus arbitration
-      twi_error = TW_MT_ARB_LOST;
-      twi_releaseBus();
+      twi_finish(4);
       break;
 
     // Master Receiver
     case TW_MR_DATA_ACK: // data received, ack sent
       // put byte into buffer
-      twi_masterBuffer[twi_masterBufferIndex++] = TWDR;
+      twi_current->rxData[twi_masterBufferIndex++] = TWDR;
     case TW_MR_SLA_ACK:  // address sent, ack received
       // ack if more bytes are expected, otherwise nack
-      if(twi_masterBufferIndex < twi_masterBufferLength){
+      // On receive, the previously configured ACK/NACK setting is
+      // transmitted in response to the received byte before the interrupt
+      // is signalled, so the NACK is set up when the next to last byte
+      // comes in.
+      if(twi_masterBufferIndex + 1 < twi_current->rxLength){
         twi_reply(1);
       }else{
         twi_reply(0);
@@ -399,12 +777,15 @@ SIGNAL(TWI_vect) {
       break;
     case TW_MR_DATA_NACK: // data received, nack sent
       // put final byte into buffer
-      twi_masterBuffer[twi_masterBufferIndex++] = TWDR;
+      twi_current->rxData[twi_masterBufferIndex++] = TWDR;
+      twi_finish(0);
+      break;
     case TW_MR_SLA_NACK: // address sent, nack received
-      twi_stop();
+      twi_finish(2);
       break;
     // TW_MR_ARB_LOST handled by TW_MT_ARB_LOST case
 
+#ifdef TWI_SLAVE
     // Slave Receiver
     case TW_SR_SLA_ACK:   // addressed, returned ack
     case TW_SR_GCALL_ACK: // addressed generally, returned ack
@@ -436,11 +817,14 @@ SIGNAL(TWI_vect) {
       // sends ack and stops interface for clock stretching
       twi_stop();
       // callback to user defined callback
-      twi_onSlaveReceive(twi_rxBuffer, twi_rxBufferIndex);
+      if(twi_onSlaveReceive){
+        twi_onSlaveReceive(twi_rxBuffer, twi_rxBufferIndex);
+      }
       // since we submit rx buffer to "wire" library, we can reset it
       twi_rxBufferIndex = 0;
       // ack future responses and leave slave receiver state
       twi_releaseBus();
+      twi_resume();
       break;
     case TW_SR_DATA_NACK:       // data received, returned nack
     case TW_SR_GCALL_DATA_NACK: // data received generally, returned nack
@@ -459,7 +843,9 @@ SIGNAL(TWI_vect) {
       twi_txBufferLength = 0;
       // request for txBuffer to be filled and length to be set
       // note: user must call twi_transmit(bytes, length) to do this
-      twi_onSlaveTransmit();
+      if(twi_onSlaveTransmit){
+        twi_onSlaveTransmit();
+      }
       // if they didn't change buffer & length, initialize it
       if(0 == twi_txBufferLength){
         twi_txBufferLength = 1;
@@ -482,14 +868,19 @@ SIGNAL(TWI_vect) {
       twi_reply(1);
       // leave slave receiver state
       twi_state = TWI_READY;
+      twi_resume();
       break;
+#endif
 
     // All
     case TW_NO_INFO:   // no state information
       break;
     case TW_BUS_ERROR: // bus error, illegal stop/start
-      twi_error = TW_BUS_ERROR;
-      twi_stop();
+      if(TWI_MTX == twi_state || TWI_MRX == twi_state){
+        twi_finish(4);
+      }else{
+        twi_stop();
+      }
       break;
   }
 }
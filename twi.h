@@ -1,14 +1,73 @@
-#define TWI_FREQ 100000L
+// bus speeds for twi_setFrequency, TWI_FREQ is used after twi_init
+#define TWI_FREQ_STANDARD 100000L
+#define TWI_FREQ_FAST     400000L
+#ifndef TWI_FREQ
+#define TWI_FREQ TWI_FREQ_STANDARD
+#endif
 
-#define BUFFER_LENGTH 32
-#define TWI_BUFFER_LENGTH 32
+// The driver is master only unless TWI_SLAVE is defined, which adds
+// the slave receiver/transmitter states and their buffers
+
+// size of the rx/tx buffers behind requestFrom/send
+#ifndef BUFFER_LENGTH
+#define BUFFER_LENGTH 8
+#endif
+// size of the buffer for non-waiting writes and the slave buffers
+#ifndef TWI_BUFFER_LENGTH
+#define TWI_BUFFER_LENGTH 8
+#endif
 
 #define TWI_READY 0
 #define TWI_MRX   1
 #define TWI_MTX   2
 #define TWI_SRX   3
 #define TWI_STX   4
+#define TWI_STOPPING 5  // stop sent, the hardware is still putting it on the bus
+
+// transaction status codes
+#define TWI_OK        0
+#define TWI_ETOOLONG  1   // length to long for buffer
+#define TWI_EADDRNACK 2   // address send, NACK received
+#define TWI_EDATANACK 3   // data send, NACK received
+#define TWI_EOTHER    4   // lost bus arbitration, bus error, queue full
+#define TWI_ETIMEOUT  5   // no completion in time, bus was recovered
+#define TWI_PENDING   0xFF // queued or running
+
+// default time a blocking call waits for its transaction, in us
+#ifndef TWI_TIMEOUT_US
+#define TWI_TIMEOUT_US 10000
+#endif
+
+// period of the clock pulses twi_recover uses to free the bus, in us
+#define TWI_POLL_US 10
 
+// max number of transactions waiting for the bus
+#define TWI_QUEUE_LENGTH 4
+
+// flags for a transaction
+#define TWI_TXN_REG 0x01  // send reg ahead of txData
+#define TWI_TXN_READ 0x02 // plain read, SLA+R straight away
+
+// A master transaction: txLength bytes are written, then rxLength bytes
+// are read after a repeated start. Either part may be empty, a write of
+// nothing just addresses the device. With TWI_TXN_REG set the register
+// address in reg is written first. With TWI_TXN_READ there is no write
+// part and at least one byte is read. Both
+// buffers belong to the caller and are accessed directly from the ISR,
+// so they must stay valid until the status is no longer TWI_PENDING.
+// On completion rxLength holds the number of bytes actually read and
+// the callback, if any, is run from the ISR.
+typedef struct twi_txn {
+  uint8_t address;
+  uint8_t flags;
+  uint8_t reg;
+  const uint8_t* txData;
+  uint8_t txLength;
+  uint8_t* rxData;
+  uint8_t rxLength;
+  void (*callback)(struct twi_txn*);
+  volatile uint8_t status;
+} twi_txn;
 
 
 
@@ -22,12 +81,22 @@ uint8_t available(void);
 uint8_t receive(void);
 
 void twi_init(void);
-void twi_setAddress(uint8_t address);
+uint8_t twi_setFrequency(uint32_t frequency);
+uint8_t twi_submit(twi_txn* txn);
+uint8_t twi_wait(twi_txn* txn);
+void twi_setTimeout(uint16_t us);
+void twi_recover(void);
+uint16_t twi_getErrorCount(void);
+uint8_t twi_readRegs(uint8_t address, uint8_t reg, uint8_t* data, uint8_t length);
+uint8_t twi_writeRegs(uint8_t address, uint8_t reg, const uint8_t* data, uint8_t length);
 uint8_t twi_readFrom(uint8_t address, uint8_t* data, uint8_t length);
 uint8_t twi_writeTo(uint8_t address, uint8_t* data, uint8_t length, uint8_t wait);
+#ifdef TWI_SLAVE
+void twi_setAddress(uint8_t address);
 uint8_t twi_transmit(uint8_t* data, uint8_t length);
-//void twi_attachSlaveRxEvent( void (*function)(uint8_t*, int) );
-//void twi_attachSlaveTxEvent( void (*function)(void) );
+void twi_attachSlaveRxEvent( void (*function)(uint8_t*, int) );
+void twi_attachSlaveTxEvent( void (*function)(void) );
+#endif
 void twi_reply(uint8_t ack);
 void twi_stop(void);
 void twi_releaseBus(void);
@@ -0,0 +1,133 @@
+//
+//	uart.c - Interrupt driven USART0 with receive and transmit rings
+//
+//    Received bytes are put in the RX ring by the receive interrupt,
+//    which also wakes the line task when a CR or LF arrives, so the
+//    console only has to look at the ring once a line is complete.
+//    Transmitted bytes go into the TX ring and are sent from the data
+//    register empty interrupt. UartPutc() sleeps while the ring is full.
+//
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/power.h>
+#include <avr/sleep.h>
+
+#include "sched.h"
+#include "uart.h"
+
+#define UBRR_VALUE	((F_CPU+4*UART_BAUD)/(8*UART_BAUD)-1)
+
+static volatile char rxBuf[UART_RX_SIZE];
+static volatile uint8_t rxHead;
+static volatile uint8_t rxTail;
+static volatile char txBuf[UART_TX_SIZE];
+static volatile uint8_t txHead;
+static volatile uint8_t txTail;
+
+static uint8_t rxTask=NO_TASK;
+
+
+
+//
+// Store a received byte, dropping it when the ring is full
+//
+ISR(USART_RX_vect) {
+	uint8_t next;
+	char c;
+
+	c=UDR0;
+	next=(rxHead+1)&(UART_RX_SIZE-1);
+	if (next!=rxTail) {
+		rxBuf[rxHead]=c;
+		rxHead=next;
+	}
+	if (c=='\r' || c=='\n') WakeTask(rxTask);
+}
+
+
+
+//
+// Send the next byte, or turn the interrupt off when the ring is empty
+//
+ISR(USART_UDRE_vect) {
+	if (txHead==txTail) {
+		UCSR0B&=~(1<<UDRIE0);
+		return;
+	}
+	UDR0=txBuf[txTail];
+	txTail=(txTail+1)&(UART_TX_SIZE-1);
+}
+
+
+
+//
+// Power up the USART at UART_BAUD 8N1, lineTask is woken at each end
+// of line
+//
+void InitUART(uint8_t lineTask) {
+	rxTask=lineTask;
+	power_usart0_enable();
+	UBRR0=UBRR_VALUE;
+	UCSR0A=(1<<U2X0);
+	UCSR0C=(1<<UCSZ01)|(1<<UCSZ00);
+	UCSR0B=(1<<RXCIE0)|(1<<RXEN0)|(1<<TXEN0);
+}
+
+
+
+//
+// Next received byte, or UART_NONE
+//
+int16_t UartGetc(void) {
+	char c;
+
+	if (rxHead==rxTail) return UART_NONE;
+	c=rxBuf[rxTail];
+	rxTail=(rxTail+1)&(UART_RX_SIZE-1);
+	return (uint8_t)c;
+}
+
+
+
+//
+//
+//
+void UartPutc(char c) {
+	uint8_t next;
+
+	next=(txHead+1)&(UART_TX_SIZE-1);
+	while (next==txTail) {
+		sleep_mode();		// Woken by the UDRE interrupt
+	}
+	txBuf[txHead]=c;
+	txHead=next;
+	UCSR0B|=(1<<UDRIE0);
+}
+
+
+
+//
+//
+//
+void UartPuts_P(PGM_P s) {
+	char c;
+
+	while ((c=pgm_read_byte(s++))!=0) {
+		UartPutc(c);
+	}
+}
+
+
+
+//
+// Two hex digits
+//
+void UartPutHex(uint8_t v) {
+	uint8_t n;
+
+	n=v>>4;
+	UartPutc(n<10 ? '0'+n : 'A'-10+n);
+	n=v&0x0f;
+	UartPutc(n<10 ? '0'+n : 'A'-10+n);
+}
@@ -0,0 +1,26 @@
+#ifndef UART_H
+#define UART_H
+
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+// Line speed on PD0/RXD and PD1/TXD. The USART runs in double speed
+// mode, 38400 is 0.2% off at 8MHz.
+#ifndef UART_BAUD
+#define UART_BAUD	38400UL
+#endif
+
+// Ring buffer sizes, must be powers of two
+#define UART_RX_SIZE	16
+#define UART_TX_SIZE	32
+
+// Returned by UartGetc() when nothing has been received
+#define UART_NONE	-1
+
+void InitUART(uint8_t lineTask);
+int16_t UartGetc(void);
+void UartPutc(char c);
+void UartPuts_P(PGM_P s);
+void UartPutHex(uint8_t v);
+
+#endif